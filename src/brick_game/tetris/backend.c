@@ -1,21 +1,207 @@
 #include "backend.h"
 
+#include "replay.h"
+
+/**
+ * Все 7 фигур во всех 4 поворотах. Поворот i+1 получается из поворота i
+ * поворотом рамки 4x4 на 90° по часовой стрелке, порядок фигур совпадает с
+ * цветами 1–7.
+ */
+const PieceShape_t tetromino_table[PIECE_COUNT][ROTATION_COUNT] = {
+    {/* I */
+     {0x000000000000000full, 0, 3, 0, 0, {{0, 0}, {0, 1}, {0, 2}, {0, 3}},
+      {0, 0, 0, 0}},
+     {0x0001000100010001ull, 3, 3, 0, 3, {{0, 3}, {1, 3}, {2, 3}, {3, 3}},
+      {-1, -1, -1, 3}},
+     {0x000000000000000full, 0, 3, 3, 3, {{3, 0}, {3, 1}, {3, 2}, {3, 3}},
+      {3, 3, 3, 3}},
+     {0x0001000100010001ull, 0, 0, 0, 3, {{0, 0}, {1, 0}, {2, 0}, {3, 0}},
+      {3, -1, -1, -1}}
+    },
+    {/* O */
+     {0x0000000000030003ull, 1, 2, 1, 2, {{1, 1}, {1, 2}, {2, 1}, {2, 2}},
+      {-1, 2, 2, -1}},
+     {0x0000000000030003ull, 1, 2, 1, 2, {{1, 1}, {1, 2}, {2, 1}, {2, 2}},
+      {-1, 2, 2, -1}},
+     {0x0000000000030003ull, 1, 2, 1, 2, {{1, 1}, {1, 2}, {2, 1}, {2, 2}},
+      {-1, 2, 2, -1}},
+     {0x0000000000030003ull, 1, 2, 1, 2, {{1, 1}, {1, 2}, {2, 1}, {2, 2}},
+      {-1, 2, 2, -1}}
+    },
+    {/* T */
+     {0x0000000000070002ull, 0, 2, 0, 1, {{0, 1}, {1, 0}, {1, 1}, {1, 2}},
+      {1, 1, 1, -1}},
+     {0x0000000100030001ull, 2, 3, 0, 2, {{0, 2}, {1, 2}, {1, 3}, {2, 2}},
+      {-1, -1, 2, 1}},
+     {0x0000000000020007ull, 1, 3, 2, 3, {{2, 1}, {2, 2}, {2, 3}, {3, 2}},
+      {-1, 2, 3, 2}},
+     {0x0000000200030002ull, 0, 1, 1, 3, {{1, 1}, {2, 0}, {2, 1}, {3, 1}},
+      {2, 3, -1, -1}}
+    },
+    {/* J */
+     {0x0000000000070001ull, 0, 2, 0, 1, {{0, 0}, {1, 0}, {1, 1}, {1, 2}},
+      {1, 1, 1, -1}},
+     {0x0000000100010003ull, 2, 3, 0, 2, {{0, 2}, {0, 3}, {1, 2}, {2, 2}},
+      {-1, -1, 2, 0}},
+     {0x0000000000040007ull, 1, 3, 2, 3, {{2, 1}, {2, 2}, {2, 3}, {3, 3}},
+      {-1, 2, 2, 3}},
+     {0x0000000300020002ull, 0, 1, 1, 3, {{1, 1}, {2, 1}, {3, 0}, {3, 1}},
+      {3, 3, -1, -1}}
+    },
+    {/* L */
+     {0x0000000000070004ull, 0, 2, 0, 1, {{0, 2}, {1, 0}, {1, 1}, {1, 2}},
+      {1, 1, 1, -1}},
+     {0x0000000300010001ull, 2, 3, 0, 2, {{0, 2}, {1, 2}, {2, 2}, {2, 3}},
+      {-1, -1, 2, 2}},
+     {0x0000000000010007ull, 1, 3, 2, 3, {{2, 1}, {2, 2}, {2, 3}, {3, 1}},
+      {-1, 3, 2, 2}},
+     {0x0000000200020003ull, 0, 1, 1, 3, {{1, 0}, {1, 1}, {2, 1}, {3, 1}},
+      {1, 3, -1, -1}}
+    },
+    {/* S */
+     {0x0000000000030006ull, 0, 2, 0, 1, {{0, 1}, {0, 2}, {1, 0}, {1, 1}},
+      {1, 1, 0, -1}},
+     {0x0000000200030001ull, 2, 3, 0, 2, {{0, 2}, {1, 2}, {1, 3}, {2, 3}},
+      {-1, -1, 1, 2}},
+     {0x0000000000030006ull, 1, 3, 2, 3, {{2, 2}, {2, 3}, {3, 1}, {3, 2}},
+      {-1, 3, 3, 2}},
+     {0x0000000200030001ull, 0, 1, 1, 3, {{1, 0}, {2, 0}, {2, 1}, {3, 1}},
+      {2, 3, -1, -1}}
+    },
+    {/* Z */
+     {0x0000000000060003ull, 0, 2, 0, 1, {{0, 0}, {0, 1}, {1, 1}, {1, 2}},
+      {0, 1, 1, -1}},
+     {0x0000000100030002ull, 2, 3, 0, 2, {{0, 3}, {1, 2}, {1, 3}, {2, 2}},
+      {-1, -1, 2, 1}},
+     {0x0000000000060003ull, 1, 3, 2, 3, {{2, 1}, {2, 2}, {3, 2}, {3, 3}},
+      {-1, 2, 3, 3}},
+     {0x0000000100030002ull, 0, 1, 1, 3, {{1, 1}, {2, 0}, {2, 1}, {3, 0}},
+      {3, 2, -1, -1}}
+    }};
+
 /**
- * @brief Копирует форму и цвет из следующей фигуры в текущую.
+ * @brief Делает следующую фигуру текущей в начальном повороте.
  *
  * @param gc Указатель на контекст игры.
  */
 void nextCurrentInit(GameContext_t *gc) {
+  gc->current.piece = (int8_t)gc->next_piece;
+  gc->current.rotation = 0;
+}
+
+/**
+ * @brief Записывает цвет во все клетки цветного поля, занятые фигурой.
+ *
+ * @param gc    Указатель на контекст игры.
+ * @param color Цвет (0 — стереть).
+ */
+static void paintFigure(GameContext_t *gc, int color) {
+  const Tetromino_t *t = &gc->current;
+  const PieceShape_t *s = figureShape(t);
   for (int i = 0; i < FIGURE_SIZE; i++) {
-    for (int j = 0; j < FIGURE_SIZE; j++) {
-      gc->current.shape[i][j] = gc->info.next[i][j];
-      if (gc->info.next[i][j]) {
-        gc->current.color = gc->info.next[i][j];
-      }
+    gc->cells[t->y + s->cells[i][0]][t->x + s->cells[i][1]] = (uint8_t)color;
+  }
+}
+
+/**
+ * @brief Ищет верхнюю занятую клетку столбца, начиная со строки from.
+ *
+ * @param gc   Указатель на контекст игры.
+ * @param x    Столбец.
+ * @param from Первая просматриваемая строка.
+ * @return Номер строки или FIELD_HEIGHT, если ниже from столбец пуст.
+ */
+static int columnTop(const GameContext_t *gc, int x, int from) {
+  int y = from;
+  while (y < FIELD_HEIGHT && !(gc->rows[y] & ((Row_t)1 << x))) y++;
+  return y;
+}
+
+/**
+ * @brief Пересчитывает карту высот по битборду целиком. Падающая фигура
+ * нарисована на поле в состояниях STATE_FALLING и STATE_PAUSED, её клетки в
+ * высоты не входят.
+ *
+ * @param gc Указатель на контекст игры.
+ */
+static void rebuildHeights(GameContext_t *gc) {
+  Row_t piece[FIELD_HEIGHT + FIGURE_SIZE] = {0};
+  const Tetromino_t *t = &gc->current;
+  if ((gc->state == STATE_FALLING || gc->state == STATE_PAUSED) &&
+      figureInBounds(t)) {
+    const PieceShape_t *s = figureShape(t);
+    for (int i = 0; i < FIGURE_SIZE; i++) {
+      piece[t->y + s->top + i] = pieceRow(s, i, t->x + s->left);
+    }
+  }
+  memset(gc->heights, FIELD_HEIGHT, sizeof(gc->heights));
+  Row_t seen = 0;
+  for (int y = 0; y < FIELD_HEIGHT; y++) {
+    Row_t fresh = (Row_t)(gc->rows[y] & ~piece[y] & ~seen);
+    seen |= fresh;
+    for (; fresh; fresh &= (Row_t)(fresh - 1)) {
+      gc->heights[__builtin_ctzll(fresh)] = (int8_t)y;
     }
   }
 }
 
+/**
+ * @brief Устанавливает клетку поля: цвет и бит занятости в битборде.
+ *
+ * @param gc    Указатель на контекст игры.
+ * @param y     Строка.
+ * @param x     Столбец.
+ * @param color Цвет клетки (0 — пустая).
+ */
+void setCell(GameContext_t *gc, int y, int x, int color) {
+  if (y >= 0 && y < FIELD_HEIGHT && x >= 0 && x < FIELD_WIDTH) {
+    gc->cells[y][x] = (uint8_t)color;
+    gc->hash ^= rowKey(y, gc->rows[y]);
+    if (color) {
+      gc->rows[y] |= (Row_t)((Row_t)1 << x);
+      if (y < gc->heights[x]) gc->heights[x] = (int8_t)y;
+    } else {
+      gc->rows[y] &= (Row_t) ~((Row_t)1 << x);
+      if (y == gc->heights[x]) gc->heights[x] = (int8_t)columnTop(gc, x, y);
+    }
+    gc->hash ^= rowKey(y, gc->rows[y]);
+    gc->full_rows &= ~(1ull << y);
+    gc->full_rows |= (uint64_t)(gc->rows[y] == FULL_ROW) << y;
+  }
+}
+
+/**
+ * @brief Считает хеш Зобриста отрезка строк: XOR их ключей rowKey().
+ *
+ * @param rows  Первая строка отрезка.
+ * @param y     Номер первой строки на поле.
+ * @param count Число строк.
+ * @return Хеш отрезка.
+ */
+uint64_t rowsKey(const Row_t *rows, int y, int count) {
+  uint64_t key = 0;
+  for (int i = 0; i < count; i++) key ^= rowKey(y + i, rows[i]);
+  return key;
+}
+
+/**
+ * @brief Возвращает хеш позиции: занятость поля вместе с падающей фигурой,
+ * положение и поворот падающей фигуры и следующая фигура. Занятость ведут
+ * drawFigure, clearFigure, setCell и clearLines, поэтому вызов не
+ * сканирует поле.
+ *
+ * @param gc Указатель на контекст игры.
+ * @return Хеш позиции.
+ */
+uint64_t contextHash(const GameContext_t *gc) {
+  const Tetromino_t *t = &gc->current;
+  uint64_t piece = (uint64_t)(uint8_t)t->piece | (uint64_t)(uint8_t)t->rotation
+                   << 8 | (uint64_t)(uint8_t)t->x << 16 |
+                   (uint64_t)(uint8_t)t->y << 24 |
+                   (uint64_t)(uint8_t)gc->next_piece << 32;
+  return gc->hash ^ hashMix(piece + 0x9e3779b97f4a7c15ull);
+}
+
 /**
  * @brief Сохраняет рекордный счёт в файл record.txt.
  *
@@ -29,6 +215,43 @@ void saveHighScore(int score) {
   }
 }
 
+/**
+ * @brief Читает рекорд из файла record.txt.
+ *
+ * @return Сохранённый рекорд или 0, если файла нет.
+ */
+int loadHighScore(void) {
+  int score = 0;
+  FILE *f = fopen("record.txt", "r");
+  if (f) {
+    if (fscanf(f, "%d", &score) != 1) score = 0;
+    fclose(f);
+  }
+  return score;
+}
+
+/**
+ * @brief Приёмник рекорда по умолчанию: пишет его в record.txt.
+ *
+ * @param score Новый рекорд.
+ * @param data  Не используется.
+ */
+void fileHighScoreSink(int score, void *data) {
+  (void)data;
+  saveHighScore(score);
+}
+
+/**
+ * @brief Передаёт текущий счёт приёмнику рекорда контекста, если он задан.
+ *
+ * @param gc Указатель на контекст игры.
+ */
+static void reportHighScore(GameContext_t *gc) {
+  if (gc->high_score_sink) {
+    gc->high_score_sink(gc->info.score, gc->high_score_data);
+  }
+}
+
 /**
  * @brief Проверяет, не выходит ли текущая фигура за границы поля и не
  * пересекается ли с уже занятыми ячейками.
@@ -37,23 +260,10 @@ void saveHighScore(int score) {
  * @return 1, если перемещение/вращение возможно; 0 — в противном случае.
  */
 int checkCollision(GameContext_t *gc) {
-  int is_possible = 1;
-  for (int i = 0; i < FIGURE_SIZE && is_possible; i++) {
-    for (int j = 0; j < FIGURE_SIZE && is_possible; j++) {
-      if (gc->current.shape[i][j]) {
-        int abs_x = gc->current.x + j;
-        int abs_y = gc->current.y + i;
-        if (abs_x < 0 || abs_x >= FIELD_WIDTH || abs_y < 0 ||
-            abs_y >= FIELD_HEIGHT) {
-          is_possible = 0;
-        }
-        if (is_possible && abs_y >= 0 && gc->info.field[abs_y][abs_x] != 0) {
-          is_possible = 0;
-        }
-      }
-    }
-  }
-  return is_possible;
+  const Tetromino_t *t = &gc->current;
+  const PieceShape_t *s = figureShape(t);
+  return figureInBounds(t) &&
+         !pieceHits(&gc->rows[t->y + s->top], s, t->x + s->left);
 }
 
 /**
@@ -72,20 +282,13 @@ int canFall(GameContext_t *gc) {
 /**
  * @brief Поворачивает текущую фигуру на 90° по часовой стрелке.
  *
+ * Поворот — это переход к следующей записи tetromino_table, без копирования
+ * формы.
+ *
  * @param gc Указатель на контекст игры.
  */
 void rotateTetromino(GameContext_t *gc) {
-  int temp_shape[FIGURE_SIZE][FIGURE_SIZE];
-  for (int i = 0; i < FIGURE_SIZE; i++) {
-    for (int j = 0; j < FIGURE_SIZE; j++) {
-      temp_shape[i][j] = gc->current.shape[i][j];
-    }
-  }
-  for (int i = 0; i < FIGURE_SIZE; i++) {
-    for (int j = 0; j < FIGURE_SIZE; j++) {
-      gc->current.shape[j][FIGURE_SIZE - 1 - i] = temp_shape[i][j];
-    }
-  }
+  gc->current.rotation = (int8_t)((gc->current.rotation + 1) % ROTATION_COUNT);
 }
 
 /**
@@ -94,17 +297,29 @@ void rotateTetromino(GameContext_t *gc) {
  * @param gc Указатель на контекст игры.
  */
 void drawFigure(GameContext_t *gc) {
-  for (int i = 0; i < FIGURE_SIZE; i++) {
-    for (int j = 0; j < FIGURE_SIZE; j++) {
-      if (gc->current.shape[i][j]) {
-        int abs_x = gc->current.x + j;
-        int abs_y = gc->current.y + i;
-        if (abs_y >= 0 && abs_x >= 0 && abs_x < FIELD_WIDTH &&
-            abs_y < FIELD_HEIGHT) {
-          gc->info.field[abs_y][abs_x] = gc->current.color;
-        }
-      }
+  const Tetromino_t *t = &gc->current;
+  if (figureInBounds(t)) {
+    const PieceShape_t *s = figureShape(t);
+    Row_t *r = &gc->rows[t->y + s->top];
+    int row = t->y + s->top;
+    int span = s->bottom - s->top + 1;
+    gc->hash ^= rowsKey(r, row, span);
+#if ROW_WINDOW
+    uint64_t m = s->mask << (t->x + s->left);
+    r[0] |= (Row_t)m;
+    r[1] |= (Row_t)(m >> PIECE_LANE);
+    r[2] |= (Row_t)(m >> (2 * PIECE_LANE));
+    r[3] |= (Row_t)(m >> (3 * PIECE_LANE));
+#else
+    for (int i = 0; i < FIGURE_SIZE; i++) {
+      r[i] |= pieceRow(s, i, t->x + s->left);
+    }
+#endif
+    gc->hash ^= rowsKey(r, row, span);
+    for (int i = 0; i < span; i++) {
+      gc->full_rows |= (uint64_t)(r[i] == FULL_ROW) << (row + i);
     }
+    paintFigure(gc, t->piece + 1);
   }
 }
 
@@ -114,17 +329,42 @@ void drawFigure(GameContext_t *gc) {
  * @param gc Указатель на контекст игры.
  */
 void clearFigure(GameContext_t *gc) {
-  for (int i = 0; i < FIGURE_SIZE; i++) {
-    for (int j = 0; j < FIGURE_SIZE; j++) {
-      if (gc->current.shape[i][j]) {
-        int abs_x = gc->current.x + j;
-        int abs_y = gc->current.y + i;
-        if (abs_y >= 0 && abs_y < FIELD_HEIGHT && abs_x >= 0 &&
-            abs_x < FIELD_WIDTH) {
-          gc->info.field[abs_y][abs_x] = 0;
-        }
-      }
+  const Tetromino_t *t = &gc->current;
+  if (figureInBounds(t)) {
+    const PieceShape_t *s = figureShape(t);
+    Row_t *r = &gc->rows[t->y + s->top];
+    int span = s->bottom - s->top + 1;
+    gc->hash ^= rowsKey(r, t->y + s->top, span);
+#if ROW_WINDOW
+    uint64_t m = s->mask << (t->x + s->left);
+    r[0] &= (Row_t)~m;
+    r[1] &= (Row_t)~(m >> PIECE_LANE);
+    r[2] &= (Row_t)~(m >> (2 * PIECE_LANE));
+    r[3] &= (Row_t)~(m >> (3 * PIECE_LANE));
+#else
+    for (int i = 0; i < FIGURE_SIZE; i++) {
+      r[i] &= (Row_t)~pieceRow(s, i, t->x + s->left);
     }
+#endif
+    gc->hash ^= rowsKey(r, t->y + s->top, span);
+    gc->full_rows &= ~(0xfull << (t->y + s->top));
+    paintFigure(gc, 0);
+  }
+}
+
+/**
+ * @brief Фиксирует уже нарисованную текущую фигуру: поднимает карту высот в
+ * занятых ею столбцах.
+ *
+ * @param gc Указатель на контекст игры.
+ */
+static void lockFigure(GameContext_t *gc) {
+  const Tetromino_t *t = &gc->current;
+  const PieceShape_t *s = figureShape(t);
+  for (int i = 0; i < FIGURE_SIZE; i++) {
+    int y = t->y + s->cells[i][0];
+    int x = t->x + s->cells[i][1];
+    if (y < gc->heights[x]) gc->heights[x] = (int8_t)y;
   }
 }
 
@@ -157,6 +397,7 @@ void autoMoveDown(GameContext_t *gc) {
     if (!checkCollision(gc)) {
       gc->current.y -= 1;
       drawFigure(gc);
+      lockFigure(gc);
       gc->state = STATE_CLEARING;
     } else {
       drawFigure(gc);
@@ -168,30 +409,48 @@ void autoMoveDown(GameContext_t *gc) {
  * @brief Очищает заполненные линии, сдвигает всё сверху вниз, обновляет счёт,
  * уровень и скорость. Сохраняет новый рекорд, если он побит.
  *
+ * Полные строки известны заранее из маски full_rows, которую обновляют
+ * drawFigure, clearFigure и setCell, поэтому поле не сканируется. Строки ниже
+ * самой нижней полной не трогаются, а каждый отрезок между полными строками
+ * сдвигается вниз одним memmove слов битборда и строк цветного поля.
+ * Освободившиеся сверху строки обнуляются.
+ *
+ * Вершина столбца, лежавшая выше всех полных строк, опускается на их число;
+ * если же она сама была в полной строке, столбец досматривается вниз. Ключи
+ * Зобриста зависят от номера строки, поэтому после сдвига хеш поля
+ * пересчитывается по непустым строкам.
+ *
  * @param gc Указатель на контекст игры.
  */
 void clearLines(GameContext_t *gc) {
   int counter = 0;
-  for (int i = FIELD_HEIGHT - 1; i >= 0; --i) {
-    int full_line = 1;
-    for (int j = 0; j < FIELD_WIDTH && full_line; ++j) {
-      if (gc->info.field[i][j] == 0) {
-        full_line = 0;
-      }
-    }
-    if (full_line) {
-      counter++;
-      for (int k = i; k > 0; k--) {
-        for (int j = 0; j < FIELD_WIDTH; j++) {
-          gc->info.field[k][j] = gc->info.field[k - 1][j];
-        }
-      }
-      for (int j = 0; j < FIELD_WIDTH; j++) {
-        gc->info.field[0][j] = 0;
-      }
-      i++;
+  uint64_t full = gc->full_rows;
+  int row = full ? 63 - __builtin_clzll(full) : -1;
+  while (row >= 0) {
+    counter++;
+    uint64_t above = full & ((1ull << row) - 1);
+    int next = above ? 63 - __builtin_clzll(above) : -1;
+    size_t len = (size_t)(row - 1 - next);
+    memmove(&gc->rows[next + 1 + counter], &gc->rows[next + 1],
+            len * sizeof(Row_t));
+    memmove(&gc->cells[next + 1 + counter], &gc->cells[next + 1],
+            len * sizeof(gc->cells[0]));
+    row = next;
+  }
+  gc->full_rows = 0;
+  memset(gc->cells, 0, (size_t)counter * sizeof(gc->cells[0]));
+  memset(gc->rows, 0, (size_t)counter * sizeof(Row_t));
+  if (counter) gc->hash = rowsKey(gc->rows, 0, FIELD_HEIGHT);
+  for (int x = 0; counter && x < FIELD_WIDTH; x++) {
+    int top = gc->heights[x];
+    if (top >= FIELD_HEIGHT) continue;
+    if (full >> top & 1) {
+      gc->heights[x] = (int8_t)columnTop(gc, x, top);
+    } else {
+      gc->heights[x] = (int8_t)(top + counter);
     }
   }
+  gc->lines += counter;
   switch (counter) {
     case 1:
       gc->info.score += 100;
@@ -210,90 +469,467 @@ void clearLines(GameContext_t *gc) {
   gc->info.speed = 1000 - (gc->info.level - 1) * 100;
   if (gc->info.score > gc->info.high_score) {
     gc->info.high_score = gc->info.score;
-    saveHighScore(gc->info.score);
+    reportHighScore(gc);
   }
 }
 
 /**
- * @brief Молниеносно опускает фигуру до последней доступной позиции и фиксирует
- * её на поле.
+ * @brief Находит строку, на которой остановится фигура t, если ронять её
+ * прямо вниз из текущего положения.
+ *
+ * Если фигура целиком выше поверхности стакана, ответ берётся из карты высот
+ * и нижнего профиля фигуры за O(ширина фигуры). Под нависающими клетками
+ * карта высот не годится, и фигура опускается по битборду построчно. Текущая
+ * падающая фигура контекста препятствием не считается.
  *
  * @param gc Указатель на контекст игры.
+ * @param t  Фигура в допустимом положении.
+ * @return Значение y фигуры в точке приземления.
  */
-void dropTetromino(GameContext_t *gc) {
-  int original_y = gc->current.y;
-  int max_drop = 0;
-  int collision = 0;
-  while (!collision) {
-    max_drop++;
-    gc->current.y = original_y + max_drop;
-    if (!checkCollision(gc)) {
-      collision = 1;
-      max_drop--;
+int landingRow(const GameContext_t *gc, const Tetromino_t *t) {
+  const PieceShape_t *s = figureShape(t);
+  int landing = FIELD_HEIGHT;
+  int above = 1;
+  for (int j = s->left; j <= s->right; j++) {
+    int bottom = s->col_bottom[j];
+    if (bottom < 0) continue;
+    int top = gc->heights[t->x + j];
+    above &= t->y + bottom < top;
+    if (top - 1 - bottom < landing) landing = top - 1 - bottom;
+  }
+  if (!above) {
+    Row_t rows[FIELD_HEIGHT + FIGURE_SIZE];
+    memcpy(rows, gc->rows, sizeof(rows));
+    const Tetromino_t *c = &gc->current;
+    if (figureInBounds(c)) {
+      const PieceShape_t *cs = figureShape(c);
+      for (int i = 0; i < FIGURE_SIZE; i++) {
+        rows[c->y + cs->top + i] &= (Row_t)~pieceRow(cs, i, c->x + cs->left);
+      }
+    }
+    landing = t->y;
+    for (int r = landing + s->top + 1; r + s->bottom - s->top < FIELD_HEIGHT;
+         r++) {
+      if (pieceHits(&rows[r], s, t->x + s->left)) break;
+      landing++;
+    }
+  }
+  return landing;
+}
+
+/**
+ * @brief Возвращает клетки тени падающей фигуры — её положения после
+ * мгновенного сброса.
+ *
+ * @param gc    Указатель на контекст игры.
+ * @param cells Координаты (строка, столбец) клеток тени.
+ * @return Число клеток: FIGURE_SIZE, если фигура падает, иначе 0.
+ */
+int ghostCells(const GameContext_t *gc, int cells[FIGURE_SIZE][2]) {
+  int count = 0;
+  if (gc->state == STATE_FALLING) {
+    const Tetromino_t *t = &gc->current;
+    const PieceShape_t *s = figureShape(t);
+    int y = landingRow(gc, t);
+    for (; count < FIGURE_SIZE; count++) {
+      cells[count][0] = y + s->cells[count][0];
+      cells[count][1] = t->x + s->cells[count][1];
     }
   }
-  gc->current.y = original_y + max_drop;
+  return count;
+}
+
+/**
+ * @brief Молниеносно опускает фигуру до последней доступной позиции и рисует
+ * её на поле. Точка приземления берётся из landingRow().
+ *
+ * @param gc Указатель на контекст игры.
+ */
+void dropTetromino(GameContext_t *gc) {
+  gc->current.y = (int8_t)landingRow(gc, &gc->current);
   drawFigure(gc);
 }
 
 /**
- * @brief Инициализирует следующий случайный тетромино.
+ * @brief Рисует следующую фигуру в буфере предпросмотра.
  *
  * @param gc Указатель на контекст игры.
  */
-void nextFigureInit(GameContext_t *gc) {
-  const int tetromino_shapes[7][4][4] = {
-      {{1, 1, 1, 1}, {0, 0, 0, 0}, {0, 0, 0, 0}, {0, 0, 0, 0}},
-      {{0, 0, 0, 0}, {0, 2, 2, 0}, {0, 2, 2, 0}, {0, 0, 0, 0}},
-      {{0, 3, 0, 0}, {3, 3, 3, 0}, {0, 0, 0, 0}, {0, 0, 0, 0}},
-      {{4, 0, 0, 0}, {4, 4, 4, 0}, {0, 0, 0, 0}, {0, 0, 0, 0}},
-      {{0, 0, 5, 0}, {5, 5, 5, 0}, {0, 0, 0, 0}, {0, 0, 0, 0}},
-      {{0, 6, 6, 0}, {6, 6, 0, 0}, {0, 0, 0, 0}, {0, 0, 0, 0}},
-      {{7, 7, 0, 0}, {0, 7, 7, 0}, {0, 0, 0, 0}, {0, 0, 0, 0}}};
-  int next_shape = rand() % 7;
+static void paintPreview(GameContext_t *gc) {
+  const PieceShape_t *s = &tetromino_table[gc->next_piece][0];
+  memset(gc->preview, 0, sizeof(gc->preview));
   for (int i = 0; i < FIGURE_SIZE; i++) {
-    for (int j = 0; j < FIGURE_SIZE; j++) {
-      gc->info.next[i][j] = tetromino_shapes[next_shape][i][j];
+    gc->preview[s->cells[i][0]][s->cells[i][1]] = (uint8_t)(gc->next_piece + 1);
+  }
+}
+
+/**
+ * @brief Инициализирует следующий случайный тетромино и рисует его в буфере
+ * предпросмотра.
+ *
+ * @param gc Указатель на контекст игры.
+ */
+void nextFigureInit(GameContext_t *gc) {
+  gc->next_piece = queuePop(&gc->queue);
+  paintPreview(gc);
+}
+
+
+/**
+ * @brief Возвращает контекст в начальное состояние новой игры без выделения
+ * памяти. Рекорд, приёмник рекорда и тайминги автосдвига сохраняются,
+ * генератор фигур продолжает свою последовательность.
+ *
+ * @param gc Указатель на контекст игры.
+ */
+void resetContext(GameContext_t *gc) {
+  memset(gc->cells, 0, sizeof(gc->cells));
+  memset(gc->rows, 0, sizeof(gc->rows));
+  gc->full_rows = 0;
+  gc->hash = 0;
+  memset(gc->heights, FIELD_HEIGHT, sizeof(gc->heights));
+  gc->info.level = 1;
+  gc->info.score = 0;
+  gc->info.speed = 1000;
+  gc->info.pause = 0;
+  gc->lines = 0;
+  gc->shift.direction = 0;
+  gc->state = STATE_START;
+  nextFigureInit(gc);
+  nextCurrentInit(gc);
+  nextFigureInit(gc);
+  gc->current.y = SPAWN_Y;
+  gc->current.x = SPAWN_X;
+}
+
+/**
+ * @brief Перезапускает генератор фигур контекста с новым зерном и начинает
+ * новую игру. Одинаковые зерно и рандомайзер дают одинаковую
+ * последовательность фигур.
+ *
+ * @param gc         Указатель на контекст игры.
+ * @param seed       Зерно генератора.
+ * @param randomizer Способ выбора фигур.
+ */
+void seedContext(GameContext_t *gc, uint64_t seed, Randomizer_t randomizer) {
+  queueInit(&gc->queue, seed, randomizer);
+  resetContext(gc);
+}
+
+/**
+ * @brief Инициализирует экземпляр игры в памяти вызывающего (на стеке, в
+ * массиве контекстов потока). Память не выделяется. Приёмник рекорда не
+ * задан, рекорд равен 0.
+ *
+ * @param gc     Указатель на контекст игры.
+ * @param config Параметры игры (NULL — зерно 0, равномерный рандомайзер).
+ */
+void initContext(GameContext_t *gc, const GameConfig_t *config) {
+  GameConfig_t defaults = {0, RANDOMIZER_UNIFORM};
+  if (!config) config = &defaults;
+  memset(gc, 0, sizeof(*gc));
+  setShiftTiming(gc, DEFAULT_DAS_MS, DEFAULT_ARR_MS);
+  seedContext(gc, config->seed, config->randomizer);
+}
+
+/**
+ * @brief Создаёт независимый экземпляр игры со своим RNG одним выделением
+ * памяти, выровненным по строке кэша.
+ *
+ * @param config Параметры игры (NULL — зерно 0, равномерный рандомайзер).
+ * @return Новый контекст или NULL, если не хватило памяти.
+ */
+GameContext_t *createContext(const GameConfig_t *config) {
+  GameContext_t *gc = aligned_alloc(CONTEXT_ALIGN, sizeof(GameContext_t));
+  if (gc) initContext(gc, config);
+  return gc;
+}
+
+/**
+ * @brief Освобождает контекст, созданный createContext().
+ *
+ * @param gc Указатель на контекст игры (может быть NULL).
+ */
+void destroyContext(GameContext_t *gc) { free(gc); }
+
+/**
+ * @brief Считает, на сколько клеток текущая фигура может съехать в сторону
+ * без поворота. Для каждой строки фигуры ближайшее препятствие находится одной
+ * битовой операцией над строкой битборда, поэтому checkCollision по столбцам
+ * не нужен. Клетки самой фигуры лежат между её крайними клетками и
+ * препятствием не считаются, так что фигура может быть нарисована на поле.
+ *
+ * @param gc        Указатель на контекст игры.
+ * @param direction -1 — влево, 1 — вправо.
+ * @return Число свободных клеток до упора.
+ */
+static int slideDistance(const GameContext_t *gc, int direction) {
+  const Tetromino_t *t = &gc->current;
+  const PieceShape_t *s = figureShape(t);
+  int distance = FIELD_WIDTH;
+  for (int i = 0; i <= s->bottom - s->top; i++) {
+    unsigned lane = (unsigned)(s->mask >> (i * PIECE_LANE)) & 0xfu;
+    uint64_t row = gc->rows[t->y + s->top + i];
+    int lo = t->x + s->left + __builtin_ctz(lane);
+    int hi = t->x + s->left + 31 - __builtin_clz(lane);
+    int room;
+    if (direction < 0) {
+      uint64_t blockers = row & ((1ull << lo) - 1);
+      room = blockers ? lo - 64 + __builtin_clzll(blockers) : lo;
+    } else {
+      uint64_t blockers = row & ~((2ull << hi) - 1);
+      room = blockers ? __builtin_ctzll(blockers) - hi - 1
+                      : FIELD_WIDTH - 1 - hi;
+    }
+    if (room < distance) distance = room;
+  }
+  return distance;
+}
+
+/**
+ * @brief Выполняет автосдвиги, наступившие к часам контекста. Все
+ * накопившиеся сдвиги (при ARR 0 — до упора) применяются одним перемещением
+ * на min(число сдвигов, расстояние до упора).
+ *
+ * @param gc Указатель на контекст игры.
+ */
+static void autoShift(GameContext_t *gc) {
+  AutoShift_t *a = &gc->shift;
+  if (a->direction && gc->state == STATE_FALLING &&
+      (int32_t)(gc->clock_ms - a->next_ms) >= 0) {
+    uint32_t due = FIELD_WIDTH;
+    if (a->arr_ms) {
+      due = (gc->clock_ms - a->next_ms) / a->arr_ms + 1;
+      a->next_ms += due * a->arr_ms;
+    }
+    int distance = slideDistance(gc, a->direction);
+    if ((uint32_t)distance > due) distance = (int)due;
+    if (distance) {
+      clearFigure(gc);
+      gc->current.x = (int8_t)(gc->current.x + a->direction * distance);
+      drawFigure(gc);
     }
   }
 }
 
 /**
- * @brief Возвращает статический контекст игры, создавая и инициализируя его при
- * первом вызове.
+ * @brief Разбирает событие удержания влево/вправо.
+ *
+ * Нажатие (hold == true для неудерживаемого направления) запоминает
+ * направление и отсчёт DAS и, как обычное нажатие, сдвигает фигуру на
+ * клетку. Повтор удержания (hold == true для удерживаемого направления)
+ * ничего не делает сверх автосдвига. Отпускание (hold == false для
+ * удерживаемого направления) прекращает автосдвиг. Остальные события
+ * обрабатываются обычным образом.
+ *
+ * @param gc     Указатель на контекст игры.
+ * @param action Действие пользователя.
+ * @param hold   Флаг удержания кнопки.
+ * @return 1, если событие поглощено и в автомат не передаётся.
+ */
+static int shiftEvent(GameContext_t *gc, UserAction_t action, bool hold) {
+  AutoShift_t *a = &gc->shift;
+  int direction = action == Left ? -1 : action == Right ? 1 : 0;
+  int consumed = 0;
+  if (direction && hold) {
+    consumed = a->direction == direction;
+    if (!consumed) {
+      a->direction = (int8_t)direction;
+      a->next_ms = gc->clock_ms + a->das_ms;
+    }
+  } else if (direction && a->direction == direction) {
+    a->direction = 0;
+    consumed = 1;
+  }
+  return consumed;
+}
+
+/**
+ * @brief Задаёт приёмник нового рекорда контекста.
+ *
+ * @param gc   Указатель на контекст игры.
+ * @param sink Функция, вызываемая при новом рекорде (NULL — не сохранять).
+ * @param data Пользовательские данные, передаваемые в sink.
+ */
+void setHighScoreSink(GameContext_t *gc, HighScoreSink_t sink, void *data) {
+  gc->high_score_sink = sink;
+  gc->high_score_data = data;
+}
+
+/**
+ * @brief Выполняет один шаг конечного автомата контекста. Если на контексте
+ * включена запись, событие и появление новой фигуры попадают в неё.
+ *
+ * Перед событием выполняются наступившие автосдвиги, затем событие
+ * влево/вправо разбирается как нажатие, удержание или отпускание (см.
+ * shiftEvent()).
+ *
+ * @param gc     Указатель на контекст игры.
+ * @param action Действие пользователя.
+ * @param hold   Флаг удержания кнопки.
+ */
+void stepContext(GameContext_t *gc, UserAction_t action, bool hold) {
+  TetrisState_t before = gc->state;
+  if (gc->recorder) {
+    replayAppend(gc->recorder, gc->clock_ms, action, hold);
+  }
+  autoShift(gc);
+  if (!shiftEvent(gc, action, hold)) {
+    inputHandler(gc, action);
+  }
+  if (gc->recorder && before == STATE_SPAWN && gc->state == STATE_FALLING) {
+    replayPieceSpawned(gc->recorder, gc);
+  }
+}
+
+/**
+ * @brief Устанавливает часы контекста, которыми помечаются записываемые
+ * события.
+ *
+ * @param gc       Указатель на контекст игры.
+ * @param clock_ms Текущее время в миллисекундах.
+ */
+void setContextClock(GameContext_t *gc, uint32_t clock_ms) {
+  gc->clock_ms = clock_ms;
+}
+
+/**
+ * @brief Задаёт тайминги автосдвига.
+ *
+ * @param gc     Указатель на контекст игры.
+ * @param das_ms Задержка от нажатия до первого автосдвига, мс.
+ * @param arr_ms Период автоповтора, мс (0 — сразу до упора).
+ */
+void setShiftTiming(GameContext_t *gc, uint16_t das_ms, uint16_t arr_ms) {
+  gc->shift.das_ms = das_ms;
+  gc->shift.arr_ms = arr_ms;
+}
+
+/**
+ * @brief Продвигает часы контекста без ввода и выполняет наступившие
+ * автосдвиги. В запись не попадает: при воспроизведении те же сдвиги
+ * выполнит следующее событие, так как они зависят только от часов.
+ *
+ * @param gc       Указатель на контекст игры.
+ * @param clock_ms Текущее время в миллисекундах.
+ */
+void advanceContext(GameContext_t *gc, uint32_t clock_ms) {
+  gc->clock_ms = clock_ms;
+  autoShift(gc);
+}
+
+/**
+ * @brief Сообщает, когда наступит следующий автосдвиг, чтобы цикл событий
+ * мог проснуться к нему и вызвать advanceContext().
+ *
+ * @param gc       Указатель на контекст игры.
+ * @param deadline Момент следующего автосдвига по часам контекста.
+ * @return 1, если автосдвиг ожидается; 0 — направление не удерживается или
+ * фигура уже упёрлась.
+ */
+int shiftDeadline(const GameContext_t *gc, uint32_t *deadline) {
+  const AutoShift_t *a = &gc->shift;
+  int pending = a->direction && gc->state == STATE_FALLING &&
+                slideDistance(gc, a->direction) > 0;
+  if (pending) *deadline = a->next_ms;
+  return pending;
+}
+
+/**
+ * @brief Сохраняет состояние игры в компактный снимок.
+ *
+ * @param gc       Указатель на контекст игры.
+ * @param snapshot Снимок.
+ */
+void saveSnapshot(const GameContext_t *gc, ContextSnapshot_t *snapshot) {
+  memset(snapshot, 0, sizeof(*snapshot));
+  memcpy(snapshot->rows, gc->rows, sizeof(snapshot->rows));
+  memcpy(snapshot->colors, gc->cells, sizeof(snapshot->colors));
+  snapshot->queue = gc->queue;
+  snapshot->current = gc->current;
+  snapshot->next_piece = (int8_t)gc->next_piece;
+  snapshot->state = (uint8_t)gc->state;
+  snapshot->pause = (uint8_t)gc->info.pause;
+  snapshot->score = gc->info.score;
+  snapshot->high_score = gc->info.high_score;
+  snapshot->level = gc->info.level;
+  snapshot->speed = gc->info.speed;
+  snapshot->lines = gc->lines;
+  snapshot->clock_ms = gc->clock_ms;
+  snapshot->shift = gc->shift;
+}
+
+/**
+ * @brief Восстанавливает состояние игры из снимка. Буферы, приёмник рекорда и
+ * запись контекста не меняются.
+ *
+ * @param gc       Указатель на контекст игры.
+ * @param snapshot Снимок.
+ */
+void loadSnapshot(GameContext_t *gc, const ContextSnapshot_t *snapshot) {
+  memcpy(gc->rows, snapshot->rows, sizeof(snapshot->rows));
+  gc->full_rows = 0;
+  for (int i = 0; i < FIELD_HEIGHT; i++) {
+    gc->full_rows |= (uint64_t)(gc->rows[i] == FULL_ROW) << i;
+  }
+  gc->hash = rowsKey(gc->rows, 0, FIELD_HEIGHT);
+  memcpy(gc->cells, snapshot->colors, sizeof(gc->cells));
+  gc->queue = snapshot->queue;
+  gc->current = snapshot->current;
+  gc->next_piece = snapshot->next_piece;
+  gc->state = (TetrisState_t)snapshot->state;
+  gc->info.pause = snapshot->pause;
+  gc->info.score = snapshot->score;
+  gc->info.high_score = snapshot->high_score;
+  gc->info.level = snapshot->level;
+  gc->info.speed = snapshot->speed;
+  gc->lines = snapshot->lines;
+  gc->clock_ms = snapshot->clock_ms;
+  gc->shift = snapshot->shift;
+  rebuildHeights(gc);
+  paintPreview(gc);
+}
+
+/**
+ * @brief Возвращает информацию об игровом состоянии контекста. Поле и
+ * предпросмотр разворачиваются из байтовых плоскостей в int в буфере
+ * вызывающего; указатели GameInfo_t действительны, пока жив буфер, и
+ * отражают состояние на момент вызова.
+ *
+ * @param gc   Указатель на контекст игры.
+ * @param view Буфер для поля и предпросмотра в int.
+ * @return Текущая информация об игре (GameInfo_t).
+ */
+GameInfo_t queryContext(const GameContext_t *gc, InfoView_t *view) {
+  for (int i = 0; i < FIELD_HEIGHT; i++) {
+    for (int j = 0; j < FIELD_WIDTH; j++) view->field[i][j] = gc->cells[i][j];
+    view->field_rows[i] = view->field[i];
+  }
+  for (int i = 0; i < FIGURE_SIZE; i++) {
+    for (int j = 0; j < FIGURE_SIZE; j++) view->next[i][j] = gc->preview[i][j];
+    view->next_rows[i] = view->next[i];
+  }
+  GameInfo_t info = gc->info;
+  info.field = view->field_rows;
+  info.next = view->next_rows;
+  return info;
+}
+
+/**
+ * @brief Возвращает контекст игры по умолчанию, создавая и инициализируя его
+ * при первом вызове. Он сохраняет рекорд в record.txt; зерно по умолчанию 0,
+ * фронтенд задаёт своё через seedContext().
  *
- * @return Указатель на одно-единственный экземпляр GameContext_t.
+ * @return Указатель на экземпляр GameContext_t по умолчанию.
  */
 GameContext_t *getContext() {
   static GameContext_t gc;
   static int is_init = 0;
   if (!is_init) {
     is_init = 1;
-    memset(&gc, 0, sizeof(gc));
-    gc.info.level = 1;
-    gc.info.score = 0;
-    gc.info.speed = 1000;
-    gc.info.pause = 0;
-    gc.state = STATE_START;
-    gc.info.field = malloc(FIELD_HEIGHT * sizeof(int *));
-    for (int i = 0; i < FIELD_HEIGHT; ++i) {
-      gc.info.field[i] = calloc(FIELD_WIDTH, sizeof(int));
-    }
-    gc.info.next = malloc(FIGURE_SIZE * sizeof(int *));
-    for (int i = 0; i < FIGURE_SIZE; i++) {
-      gc.info.next[i] = calloc(FIGURE_SIZE, sizeof(int));
-    }
-    FILE *f = fopen("record.txt", "r");
-    if (f) {
-      fscanf(f, "%d", &gc.info.high_score);
-      fclose(f);
-    }
-    nextFigureInit(&gc);
-    nextCurrentInit(&gc);
-    nextFigureInit(&gc);
-    gc.current.rotation = 0;
-    gc.current.y = 0;
-    gc.current.x = FIELD_WIDTH / 2 - 2;
+    initContext(&gc, NULL);
+    gc.info.high_score = loadHighScore();
+    setHighScoreSink(&gc, fileHighScoreSink, NULL);
   }
   return &gc;
 }
@@ -319,14 +955,13 @@ void fallingHandler(GameContext_t *gc, UserAction_t action) {
   } else if (action == Down) {
     clearFigure(gc);
     dropTetromino(gc);
+    lockFigure(gc);
     gc->state = STATE_CLEARING;
   } else if (action == Action) {
     clearFigure(gc);
-    int original_shape[FIGURE_SIZE][FIGURE_SIZE];
-    memcpy(original_shape, gc->current.shape, sizeof(original_shape));
+    int8_t original_rotation = gc->current.rotation;
     rotateTetromino(gc);
-    if (!checkCollision(gc))
-      memcpy(gc->current.shape, original_shape, sizeof(original_shape));
+    if (!checkCollision(gc)) gc->current.rotation = original_rotation;
     drawFigure(gc);
   } else if (action == Pause) {
     gc->state = STATE_PAUSED;
@@ -340,12 +975,21 @@ void fallingHandler(GameContext_t *gc, UserAction_t action) {
 }
 
 /**
- * @brief Обрабатывает пользовательский ввод, переключая состояние игры.
+ * @brief Обрабатывает пользовательский ввод контекста по умолчанию.
  *
  * @param action Действие пользователя (Start, Left, Right и т.д.).
  */
 void userInputHandler(UserAction_t action) {
-  GameContext_t *gc = getContext();
+  inputHandler(getContext(), action);
+}
+
+/**
+ * @brief Обрабатывает пользовательский ввод, переключая состояние игры.
+ *
+ * @param gc     Указатель на контекст игры.
+ * @param action Действие пользователя (Start, Left, Right и т.д.).
+ */
+void inputHandler(GameContext_t *gc, UserAction_t action) {
   if (gc->state == STATE_START) {
     if (action == Start) {
       gc->state = STATE_SPAWN;
@@ -353,8 +997,8 @@ void userInputHandler(UserAction_t action) {
   } else if (gc->state == STATE_SPAWN) {
     nextCurrentInit(gc);
     nextFigureInit(gc);
-    gc->current.y = 0;
-    gc->current.x = FIELD_WIDTH / 2 - 2;
+    gc->current.y = SPAWN_Y;
+    gc->current.x = SPAWN_X;
     if (trySpawnFigure(gc)) {
       gc->state = STATE_FALLING;
     } else {
@@ -385,14 +1029,14 @@ void userInputHandler(UserAction_t action) {
 void gameOver(GameContext_t *gc) {
   if (gc) {
     if (gc->info.score > gc->info.high_score) {
-      saveHighScore(gc->info.score);
+      reportHighScore(gc);
       gc->info.high_score = gc->info.score;
     }
-    for (int i = 0; i < FIELD_HEIGHT; i++) {
-      memset(gc->info.field[i], 0, FIELD_WIDTH * sizeof(int));
-    }
-    for (int i = 0; i < FIGURE_SIZE; i++) {
-      memset(gc->info.next[i], 0, FIGURE_SIZE * sizeof(int));
-    }
+    memset(gc->cells, 0, sizeof(gc->cells));
+    memset(gc->rows, 0, sizeof(gc->rows));
+    gc->full_rows = 0;
+    gc->hash = 0;
+    memset(gc->heights, FIELD_HEIGHT, sizeof(gc->heights));
+    memset(gc->preview, 0, sizeof(gc->preview));
   }
 }
@@ -1,15 +1,58 @@
 #ifndef BACKEND_H
 #define BACKEND_H
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "game.h"
+#include "rng.h"
 
+/**
+ * Размер поля задаётся при сборке (make FIELD_WIDTH=16 FIELD_HEIGHT=40),
+ * по умолчанию — стандартные 10x20. Все размеры — константы времени
+ * компиляции, поэтому циклы по полю разворачиваются под конкретную сборку.
+ */
+#ifndef FIELD_WIDTH
 #define FIELD_WIDTH 10
+#endif
+#ifndef FIELD_HEIGHT
 #define FIELD_HEIGHT 20
+#endif
 #define FIGURE_SIZE 4
 
+#if FIELD_WIDTH < FIGURE_SIZE || FIELD_WIDTH > 64
+#error "FIELD_WIDTH must be between 4 and 64"
+#endif
+#if FIELD_HEIGHT < FIGURE_SIZE || FIELD_HEIGHT > 64
+#error "FIELD_HEIGHT must be between 4 and 64"
+#endif
+
+/** Ширина полосы одной строки в маске фигуры (PieceShape_t.mask). */
+#define PIECE_LANE 16
+
+/**
+ * Строка битборда: бит x соответствует столбцу x. Слово выбирается по ширине
+ * поля. Если строка помещается в полосу маски фигуры (до 16 столбцов), четыре
+ * строки поля собираются в одно 64-битное окно и проверяются против маски
+ * фигуры одной операцией (ROW_WINDOW). На более широких полях фигура
+ * накладывается построчно.
+ */
+#if FIELD_WIDTH <= PIECE_LANE
+typedef uint16_t Row_t;
+#define ROW_BITS 16
+#define ROW_WINDOW 1
+#elif FIELD_WIDTH <= 32
+typedef uint32_t Row_t;
+#define ROW_BITS 32
+#define ROW_WINDOW 0
+#else
+typedef uint64_t Row_t;
+#define ROW_BITS 64
+#define ROW_WINDOW 0
+#endif
+#define FULL_ROW ((Row_t)((Row_t)~(Row_t)0 >> (ROW_BITS - FIELD_WIDTH)))
+
 typedef enum TetrisState_t {
   STATE_START,
   STATE_SPAWN,
@@ -19,23 +62,240 @@ typedef enum TetrisState_t {
   STATE_GAME_OVER
 } TetrisState_t;
 
+#define PIECE_COUNT 7
+#define ROTATION_COUNT 4
+#define SPAWN_X (FIELD_WIDTH / 2 - 2)
+#define SPAWN_Y 0
+
+/**
+ * Одно положение фигуры в рамке 4x4. Маска упакована по строкам в 64-битное
+ * слово (строка i — биты 16*i..16*i+15) и заранее сдвинута к левому верхнему
+ * углу ограничивающей рамки [left..right]x[top..bottom], поэтому её достаточно
+ * сдвинуть на x + left, чтобы наложить на поле. cells — координаты
+ * (строка, столбец) четырёх клеток внутри рамки 4x4. col_bottom — нижняя
+ * занятая строка в каждом столбце рамки (-1 — столбец пуст), по ней точка
+ * приземления считается через карту высот.
+ */
+typedef struct PieceShape_t {
+  uint64_t mask;
+  int8_t left, right, top, bottom;
+  int8_t cells[FIGURE_SIZE][2];
+  int8_t col_bottom[FIGURE_SIZE];
+} PieceShape_t;
+
+/**
+ * Падающая фигура: вид, индекс поворота и положение рамки 4x4 на поле. Цвет
+ * фигуры равен piece + 1.
+ */
 typedef struct Tetromino_t {
-  int shape[FIGURE_SIZE][FIGURE_SIZE];
-  int x, y;
-  int rotation;
-  int color;
+  int8_t piece;
+  int8_t rotation;
+  int8_t x, y;
 } Tetromino_t;
 
-typedef struct GameContext_t {
-  GameInfo_t info;
-  TetrisState_t state;
+extern const PieceShape_t tetromino_table[PIECE_COUNT][ROTATION_COUNT];
+
+/**
+ * @brief Возвращает строку i рамки фигуры как строку битборда, сдвинутую на
+ * shift столбцов.
+ *
+ * @param s     Положение фигуры.
+ * @param i     Строка от верха ограничивающей рамки.
+ * @param shift Столбец левого края рамки (x + left).
+ * @return Занятые фигурой биты строки.
+ */
+static inline Row_t pieceRow(const PieceShape_t *s, int i, int shift) {
+  return (Row_t)((Row_t)(s->mask >> (i * PIECE_LANE) & 0xfu) << shift);
+}
+
+/**
+ * @brief Возвращает положение фигуры из таблицы поворотов.
+ *
+ * @param t Указатель на фигуру.
+ * @return Указатель на запись tetromino_table.
+ */
+static inline const PieceShape_t *figureShape(const Tetromino_t *t) {
+  return &tetromino_table[t->piece][t->rotation];
+}
+
+/**
+ * @brief Проверяет, что фигура целиком лежит в пределах поля.
+ *
+ * @param t Указатель на фигуру.
+ * @return 1, если все клетки фигуры внутри поля; 0 — иначе.
+ */
+static inline int figureInBounds(const Tetromino_t *t) {
+  const PieceShape_t *s = figureShape(t);
+  return t->x + s->left >= 0 && t->x + s->right < FIELD_WIDTH &&
+         t->y + s->top >= 0 && t->y + s->bottom < FIELD_HEIGHT;
+}
+
+#if ROW_WINDOW
+/**
+ * @brief Собирает четыре строки битборда в одно 64-битное слово в той же
+ * раскладке, что и маска фигуры.
+ *
+ * @param r Верхняя строка окна.
+ * @return Окно поля 16x4.
+ */
+static inline uint64_t boardWindow(const Row_t *r) {
+  return (uint64_t)r[0] | (uint64_t)r[1] << PIECE_LANE |
+         (uint64_t)r[2] << (2 * PIECE_LANE) |
+         (uint64_t)r[3] << (3 * PIECE_LANE);
+}
+
+/**
+ * @brief Проверяет, пересекается ли фигура с занятыми клетками: окно поля
+ * сравнивается с маской фигуры одной операцией.
+ *
+ * @param r     Строка поля, на которую приходится верх рамки фигуры.
+ * @param s     Положение фигуры.
+ * @param shift Столбец левого края рамки (x + left).
+ * @return 1, если есть пересечение.
+ */
+static inline int pieceHits(const Row_t *r, const PieceShape_t *s, int shift) {
+  return (boardWindow(r) & (s->mask << shift)) != 0;
+}
+#else
+/**
+ * @brief Проверяет, пересекается ли фигура с занятыми клетками, строка за
+ * строкой: строка поля шире полосы маски фигуры.
+ *
+ * @param r     Строка поля, на которую приходится верх рамки фигуры.
+ * @param s     Положение фигуры.
+ * @param shift Столбец левого края рамки (x + left).
+ * @return 1, если есть пересечение.
+ */
+static inline int pieceHits(const Row_t *r, const PieceShape_t *s, int shift) {
+  Row_t hit = 0;
+  for (int i = 0; i <= s->bottom - s->top; i++) {
+    hit |= r[i] & pieceRow(s, i, shift);
+  }
+  return hit != 0;
+}
+#endif
+
+/**
+ * @brief Перемешивает 64-битное слово (финализатор splitmix64).
+ *
+ * @param z Слово.
+ * @return Перемешанное слово.
+ */
+static inline uint64_t hashMix(uint64_t z) {
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+  return z ^ (z >> 31);
+}
+
+/**
+ * @brief Ключ Зобриста строки поля: хеш поля — XOR ключей всех строк.
+ * Клеткой таблицы Зобриста служит номер строки, а «фигурой» на ней —
+ * содержимое строки целиком; ключ не хранится в таблице, а вычисляется
+ * перемешиванием. Пустая строка даёт 0, поэтому пустые строки в хеш не
+ * входят.
+ *
+ * @param y   Номер строки.
+ * @param row Строка битборда.
+ * @return Ключ строки.
+ */
+static inline uint64_t rowKey(int y, Row_t row) {
+  return row ? hashMix((uint64_t)row ^ (uint64_t)(y + 1) *
+                                           0x9e3779b97f4a7c15ull)
+             : 0;
+}
+
+/** Задержка автосдвига (DAS) и период автоповтора (ARR) по умолчанию, мс. */
+#define DEFAULT_DAS_MS 167
+#define DEFAULT_ARR_MS 33
+
+/**
+ * Автосдвиг при удержании влево/вправо. Пока направление удерживается,
+ * фигура сдвигается на клетку в моменты next_ms, next_ms + arr_ms, ...;
+ * первый из них наступает через das_ms после нажатия. arr_ms == 0 — фигура
+ * сразу доезжает до упора.
+ */
+typedef struct AutoShift_t {
+  int8_t direction;
+  uint16_t das_ms;
+  uint16_t arr_ms;
+  uint32_t next_ms;
+} AutoShift_t;
+
+/** Параметры создаваемой игры. */
+typedef struct GameConfig_t {
+  uint64_t seed;
+  Randomizer_t randomizer;
+} GameConfig_t;
+
+/**
+ * Компактный снимок состояния игры без указателей: его можно копировать,
+ * сохранять в файл и восстанавливать в любой контекст.
+ */
+typedef struct ContextSnapshot_t {
+  Row_t rows[FIELD_HEIGHT];
+  uint8_t colors[FIELD_HEIGHT][FIELD_WIDTH];
+  PieceQueue_t queue;
   Tetromino_t current;
+  int8_t next_piece;
+  uint8_t state;
+  uint8_t pause;
+  int32_t score, high_score, level, speed, lines;
+  uint32_t clock_ms;
+  AutoShift_t shift;
+} ContextSnapshot_t;
+
+struct Replay_t;
+
+/** Приёмник нового рекорда: вызывается, когда счёт превышает рекорд. */
+typedef void (*HighScoreSink_t)(int score, void *data);
 
+/** Выравнивание контекста и его горячих блоков: строка кэша. */
+#define CONTEXT_ALIGN 64
+
+/**
+ * Экземпляр игры. Всё состояние лежит внутри структуры одним блоком без
+ * указателей на кучу. Горячие данные идут подряд с начала: битборд, карта
+ * высот, фигура и сразу за ними байтовые плоскости цветов поля и
+ * предпросмотра (цвет 0–7 на клетку). В int они разворачиваются только в
+ * queryContext(); info.field и info.next внутри контекста не заполняются.
+ */
+typedef struct GameContext_t {
+  _Alignas(CONTEXT_ALIGN) Row_t rows[FIELD_HEIGHT + FIGURE_SIZE];
+  uint64_t full_rows;
+  /* Хеш Зобриста занятости поля вместе с падающей фигурой (rowKey). */
+  uint64_t hash;
+  /* Верхняя занятая строка каждого столбца без падающей фигуры. */
+  int8_t heights[FIELD_WIDTH];
+  Tetromino_t current;
+  TetrisState_t state;
+  int next_piece;
+  uint8_t cells[FIELD_HEIGHT][FIELD_WIDTH];
+  uint8_t preview[FIGURE_SIZE][FIGURE_SIZE];
+  GameInfo_t info;
+  PieceQueue_t queue;
+  int lines;
+  uint32_t clock_ms;
+  AutoShift_t shift;
+  struct Replay_t *recorder;
+  HighScoreSink_t high_score_sink;
+  void *high_score_data;
 } GameContext_t;
 
+/**
+ * Поле и предпросмотр, развёрнутые в int для GameInfo_t, и указатели на их
+ * строки. Живёт у того, кто читает GameInfo_t, а не в контексте.
+ */
+typedef struct InfoView_t {
+  int field[FIELD_HEIGHT][FIELD_WIDTH];
+  int next[FIGURE_SIZE][FIGURE_SIZE];
+  int *field_rows[FIELD_HEIGHT];
+  int *next_rows[FIGURE_SIZE];
+} InfoView_t;
+
 void nextFigureInit(GameContext_t *gc);
 GameContext_t *getContext();
 void userInputHandler(UserAction_t action);
+void inputHandler(GameContext_t *gc, UserAction_t action);
 int trySpawnFigure(GameContext_t *gc);
 int checkCollision(GameContext_t *gc);
 void drawFigure(GameContext_t *gc);
@@ -50,5 +310,27 @@ void fallingHandler(GameContext_t *gc, UserAction_t action);
 void autoMoveDown(GameContext_t *gc);
 int canFall(GameContext_t *gc);
 void saveHighScore(int score);
+int loadHighScore(void);
+void fileHighScoreSink(int score, void *data);
+void setCell(GameContext_t *gc, int y, int x, int color);
+int landingRow(const GameContext_t *gc, const Tetromino_t *t);
+int ghostCells(const GameContext_t *gc, int cells[FIGURE_SIZE][2]);
+
+void initContext(GameContext_t *gc, const GameConfig_t *config);
+GameContext_t *createContext(const GameConfig_t *config);
+void seedContext(GameContext_t *gc, uint64_t seed, Randomizer_t randomizer);
+void destroyContext(GameContext_t *gc);
+void resetContext(GameContext_t *gc);
+void setHighScoreSink(GameContext_t *gc, HighScoreSink_t sink, void *data);
+void stepContext(GameContext_t *gc, UserAction_t action, bool hold);
+GameInfo_t queryContext(const GameContext_t *gc, InfoView_t *view);
+void setContextClock(GameContext_t *gc, uint32_t clock_ms);
+void setShiftTiming(GameContext_t *gc, uint16_t das_ms, uint16_t arr_ms);
+void advanceContext(GameContext_t *gc, uint32_t clock_ms);
+int shiftDeadline(const GameContext_t *gc, uint32_t *deadline);
+void saveSnapshot(const GameContext_t *gc, ContextSnapshot_t *snapshot);
+void loadSnapshot(GameContext_t *gc, const ContextSnapshot_t *snapshot);
+uint64_t rowsKey(const Row_t *rows, int y, int count);
+uint64_t contextHash(const GameContext_t *gc);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,395 @@
+#include "batch.h"
+
+#include <stdatomic.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BATCH_X86 1
+#endif
+
+/** Ядро признаков: считает счётчики для полей [0, count) пачки. */
+typedef void (*BatchKernel_t)(BotBatch_t *batch);
+
+/**
+ * @brief Ядро без векторных инструкций: поля пачки по одному, строки сверху
+ * вниз, начиная с top (пустая строка выше даёт только два перехода у
+ * стенок). seen — столбцы, в которых над строкой (включительно) уже есть
+ * занятая клетка; пока заполненные строки пропускаются, по seen
+ * складываются высоты, дырки и перепады поля после очистки.
+ *
+ * @param batch Пачка.
+ */
+static void batchScalar(BotBatch_t *batch) {
+  for (int lane = 0; lane < batch->count; lane++) {
+    Row_t seen = 0;
+    int aggregate = 0, holes = 0, bumpiness = 0, lines = 0;
+    int transitions = 2 * batch->top;
+    for (int y = batch->top; y < FIELD_HEIGHT; y++) {
+      Row_t row = batch->rows[y][lane];
+      if (row == FULL_ROW) {
+        lines++;
+        continue;
+      }
+      seen |= row;
+      aggregate += __builtin_popcountll(seen);
+      holes += __builtin_popcountll(seen & (Row_t)~row);
+      Row_t bump = (seen ^ (seen >> 1)) & (FULL_ROW >> 1);
+      bumpiness += __builtin_popcountll(bump);
+      transitions += botRowTransitions(row);
+    }
+    batch->aggregate[lane] = (Row_t)aggregate;
+    batch->holes[lane] = (Row_t)holes;
+    batch->bumpiness[lane] = (Row_t)bumpiness;
+    batch->transitions[lane] = (Row_t)(transitions + 2 * lines);
+    batch->lines[lane] = (Row_t)lines;
+  }
+}
+
+#ifdef BATCH_X86
+#define BATCH_CAT(a, b) BATCH_CAT2(a, b)
+#define BATCH_CAT2(a, b) a##b
+#if ROW_BITS == 16
+#define BATCH_LANE _epi16
+#define BATCH_SET256(v) _mm256_set1_epi16((short)(v))
+#define BATCH_SET128(v) _mm_set1_epi16((short)(v))
+#elif ROW_BITS == 32
+#define BATCH_LANE _epi32
+#define BATCH_SET256(v) _mm256_set1_epi32((int)(v))
+#define BATCH_SET128(v) _mm_set1_epi32((int)(v))
+#else
+#define BATCH_LANE _epi64
+#define BATCH_SET256(v) _mm256_set1_epi64x((long long)(v))
+#define BATCH_SET128(v) _mm_set1_epi64x((long long)(v))
+#endif
+/** Операция над словами ширины строки: AVX(add) — _mm256_add_epi16 и т. п. */
+#define AVX(op) BATCH_CAT(_mm256_##op, BATCH_LANE)
+#define SSE(op) BATCH_CAT(_mm_##op, BATCH_LANE)
+
+/**
+ * @brief Считает единичные биты в каждом слове ширины строки: число бит в
+ * каждой тетраде по таблице (vpshufb), затем сумма байтов слова.
+ *
+ * @param v Слова.
+ * @return Число единичных бит каждого слова.
+ */
+__attribute__((target("avx2"))) static inline __m256i batchPopAvx2(
+    __m256i v) {
+  const __m256i table =
+      _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 0, 1, 1,
+                       2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i nibble = _mm256_set1_epi8(0x0f);
+  __m256i lo = _mm256_shuffle_epi8(table, _mm256_and_si256(v, nibble));
+  __m256i hi = _mm256_shuffle_epi8(
+      table, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+  __m256i bytes = _mm256_add_epi8(lo, hi);
+#if ROW_BITS == 64
+  return _mm256_sad_epu8(bytes, _mm256_setzero_si256());
+#else
+  __m256i words = _mm256_add_epi16(
+      _mm256_and_si256(bytes, _mm256_set1_epi16(0xff)),
+      _mm256_srli_epi16(bytes, 8));
+#if ROW_BITS == 32
+  return _mm256_madd_epi16(words, _mm256_set1_epi16(1));
+#else
+  return words;
+#endif
+#endif
+}
+
+/**
+ * @brief Ядро AVX2: то же, что batchScalar(), для 256 / ROW_BITS полей за
+ * раз. Заполненные строки не пропускаются ветвлением, а гасятся маской.
+ *
+ * @param batch Пачка.
+ */
+__attribute__((target("avx2"))) static void batchAvx2(BotBatch_t *batch) {
+  enum { STEP = 32 / (int)sizeof(Row_t) };
+  const __m256i full = BATCH_SET256(FULL_ROW);
+  const __m256i pairs = BATCH_SET256(FULL_ROW >> 1);
+  const __m256i right = BATCH_SET256((Row_t)1 << (FIELD_WIDTH - 1));
+  const __m256i one = BATCH_SET256(1);
+  for (int lane = 0; lane < batch->count; lane += STEP) {
+    __m256i seen = _mm256_setzero_si256();
+    __m256i aggregate = seen, holes = seen, bumpiness = seen;
+    __m256i transitions = BATCH_SET256(2 * batch->top), lines = seen;
+    for (int y = batch->top; y < FIELD_HEIGHT; y++) {
+      __m256i row =
+          _mm256_load_si256((const __m256i *)&batch->rows[y][lane]);
+      __m256i cleared = AVX(cmpeq)(row, full);
+      lines = AVX(sub)(lines, cleared);
+      seen = _mm256_or_si256(seen, _mm256_andnot_si256(cleared, row));
+      __m256i bump = _mm256_and_si256(
+          _mm256_xor_si256(seen, AVX(srli)(seen, 1)), pairs);
+      __m256i edges = _mm256_and_si256(
+          _mm256_xor_si256(row, _mm256_or_si256(AVX(slli)(row, 1), one)),
+          full);
+      __m256i wall =
+          AVX(srli)(_mm256_andnot_si256(row, right), FIELD_WIDTH - 1);
+      aggregate = AVX(add)(
+          aggregate, _mm256_andnot_si256(cleared, batchPopAvx2(seen)));
+      __m256i under = batchPopAvx2(_mm256_andnot_si256(row, seen));
+      holes = AVX(add)(holes, _mm256_andnot_si256(cleared, under));
+      bumpiness = AVX(add)(
+          bumpiness, _mm256_andnot_si256(cleared, batchPopAvx2(bump)));
+      transitions = AVX(add)(
+          transitions,
+          _mm256_andnot_si256(cleared,
+                              AVX(add)(batchPopAvx2(edges), wall)));
+    }
+    transitions = AVX(add)(transitions, AVX(add)(lines, lines));
+    _mm256_store_si256((__m256i *)&batch->aggregate[lane], aggregate);
+    _mm256_store_si256((__m256i *)&batch->holes[lane], holes);
+    _mm256_store_si256((__m256i *)&batch->bumpiness[lane], bumpiness);
+    _mm256_store_si256((__m256i *)&batch->transitions[lane], transitions);
+    _mm256_store_si256((__m256i *)&batch->lines[lane], lines);
+  }
+}
+
+/**
+ * @brief То же, что batchPopAvx2(), для 128-битных слов (SSSE3).
+ *
+ * @param v Слова.
+ * @return Число единичных бит каждого слова.
+ */
+__attribute__((target("sse4.1"))) static inline __m128i batchPopSse(
+    __m128i v) {
+  const __m128i table =
+      _mm_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m128i nibble = _mm_set1_epi8(0x0f);
+  __m128i lo = _mm_shuffle_epi8(table, _mm_and_si128(v, nibble));
+  __m128i hi =
+      _mm_shuffle_epi8(table, _mm_and_si128(_mm_srli_epi16(v, 4), nibble));
+  __m128i bytes = _mm_add_epi8(lo, hi);
+#if ROW_BITS == 64
+  return _mm_sad_epu8(bytes, _mm_setzero_si128());
+#else
+  __m128i words = _mm_add_epi16(_mm_and_si128(bytes, _mm_set1_epi16(0xff)),
+                                _mm_srli_epi16(bytes, 8));
+#if ROW_BITS == 32
+  return _mm_madd_epi16(words, _mm_set1_epi16(1));
+#else
+  return words;
+#endif
+#endif
+}
+
+/**
+ * @brief Ядро SSE4.1: то же, что batchAvx2(), на 128-битных регистрах.
+ *
+ * @param batch Пачка.
+ */
+__attribute__((target("sse4.1"))) static void batchSse(BotBatch_t *batch) {
+  enum { STEP = 16 / (int)sizeof(Row_t) };
+  const __m128i full = BATCH_SET128(FULL_ROW);
+  const __m128i pairs = BATCH_SET128(FULL_ROW >> 1);
+  const __m128i right = BATCH_SET128((Row_t)1 << (FIELD_WIDTH - 1));
+  const __m128i one = BATCH_SET128(1);
+  for (int lane = 0; lane < batch->count; lane += STEP) {
+    __m128i seen = _mm_setzero_si128();
+    __m128i aggregate = seen, holes = seen, bumpiness = seen;
+    __m128i transitions = BATCH_SET128(2 * batch->top), lines = seen;
+    for (int y = batch->top; y < FIELD_HEIGHT; y++) {
+      __m128i row = _mm_load_si128((const __m128i *)&batch->rows[y][lane]);
+      __m128i cleared = SSE(cmpeq)(row, full);
+      lines = SSE(sub)(lines, cleared);
+      seen = _mm_or_si128(seen, _mm_andnot_si128(cleared, row));
+      __m128i bump =
+          _mm_and_si128(_mm_xor_si128(seen, SSE(srli)(seen, 1)), pairs);
+      __m128i edges = _mm_and_si128(
+          _mm_xor_si128(row, _mm_or_si128(SSE(slli)(row, 1), one)), full);
+      __m128i wall = SSE(srli)(_mm_andnot_si128(row, right), FIELD_WIDTH - 1);
+      aggregate =
+          SSE(add)(aggregate, _mm_andnot_si128(cleared, batchPopSse(seen)));
+      __m128i under = batchPopSse(_mm_andnot_si128(row, seen));
+      holes = SSE(add)(holes, _mm_andnot_si128(cleared, under));
+      bumpiness =
+          SSE(add)(bumpiness, _mm_andnot_si128(cleared, batchPopSse(bump)));
+      transitions = SSE(add)(
+          transitions,
+          _mm_andnot_si128(cleared, SSE(add)(batchPopSse(edges), wall)));
+    }
+    transitions = SSE(add)(transitions, SSE(add)(lines, lines));
+    _mm_store_si128((__m128i *)&batch->aggregate[lane], aggregate);
+    _mm_store_si128((__m128i *)&batch->holes[lane], holes);
+    _mm_store_si128((__m128i *)&batch->bumpiness[lane], bumpiness);
+    _mm_store_si128((__m128i *)&batch->transitions[lane], transitions);
+    _mm_store_si128((__m128i *)&batch->lines[lane], lines);
+  }
+}
+#endif
+
+/** Выбранный набор инструкций; -1 — ещё не выбран. */
+static atomic_int batch_isa = -1;
+
+/**
+ * @brief Проверяет по CPUID, поддерживает ли процессор набор инструкций.
+ *
+ * @param isa Набор инструкций.
+ * @return true, если ядро этого набора можно запускать.
+ */
+static bool batchSupported(BatchIsa_t isa) {
+  bool ok = isa == BATCH_SCALAR;
+#ifdef BATCH_X86
+  __builtin_cpu_init();
+  if (isa == BATCH_SSE) ok = __builtin_cpu_supports("sse4.1");
+  if (isa == BATCH_AVX2) ok = __builtin_cpu_supports("avx2");
+#endif
+  return ok;
+}
+
+/**
+ * @brief Возвращает набор инструкций ядра признаков. При первом вызове
+ * выбирает лучший из поддерживаемых процессором.
+ *
+ * @return Набор инструкций.
+ */
+BatchIsa_t batchIsa(void) {
+  int isa = atomic_load_explicit(&batch_isa, memory_order_relaxed);
+  if (isa < 0) {
+    isa = batchSupported(BATCH_AVX2)  ? BATCH_AVX2
+          : batchSupported(BATCH_SSE) ? BATCH_SSE
+                                      : BATCH_SCALAR;
+    atomic_store_explicit(&batch_isa, isa, memory_order_relaxed);
+  }
+  return (BatchIsa_t)isa;
+}
+
+/**
+ * @brief Выбирает ядро признаков вручную (для тестов и замеров).
+ *
+ * @param isa Набор инструкций.
+ * @return false, если процессор его не поддерживает; выбор не меняется.
+ */
+bool batchSelect(BatchIsa_t isa) {
+  bool ok = batchSupported(isa);
+  if (ok) atomic_store_explicit(&batch_isa, (int)isa, memory_order_relaxed);
+  return ok;
+}
+
+/**
+ * @brief Находит верхнюю непустую строку поля.
+ *
+ * @param board Поле.
+ * @return Строка; FIELD_HEIGHT, если поле пусто.
+ */
+static int batchTop(const BotBoard_t *board) {
+  int top = 0;
+  while (top < FIELD_HEIGHT && !board->rows[top]) top++;
+  return top;
+}
+
+/**
+ * @brief Начинает пачку: копирует строки поля base во все поля пачки.
+ *
+ * @param batch Пачка.
+ * @param base  Поле, на которое кладутся фигуры.
+ */
+void batchFill(BotBatch_t *batch, const BotBoard_t *base) {
+  batch->top = batchTop(base);
+  for (int y = 0; y < FIELD_HEIGHT; y++) {
+    for (int lane = 0; lane < BATCH_LANES; lane++) {
+      batch->rows[y][lane] = base->rows[y];
+    }
+  }
+  batch->count = 0;
+}
+
+/**
+ * @brief Кладёт фигуру в очередное поле пачки (без очистки линий).
+ *
+ * @param batch Пачка, в которой меньше BATCH_LANES полей.
+ * @param t     Фигура в точке приземления.
+ */
+void batchAdd(BotBatch_t *batch, const Tetromino_t *t) {
+  const PieceShape_t *s = figureShape(t);
+  int lane = batch->count++;
+  if (t->y + s->top < batch->top) batch->top = t->y + s->top;
+  for (int i = 0; i <= s->bottom - s->top; i++) {
+    batch->rows[t->y + s->top + i][lane] |= pieceRow(s, i, t->x + s->left);
+  }
+  batch->pieces[lane] = *t;
+}
+
+/**
+ * @brief Считает признаки всех полей пачки ядром, выбранным batchIsa().
+ *
+ * @param batch Пачка.
+ */
+void batchRun(BotBatch_t *batch) {
+  static const BatchKernel_t kernels[] = {
+      batchScalar,
+#ifdef BATCH_X86
+      batchSse,
+      batchAvx2,
+#endif
+  };
+  kernels[batchIsa()](batch);
+}
+
+/**
+ * @brief Оценивает поле пачки так же, как botEvaluate() оценило бы поле
+ * base после botPlace() той же фигуры.
+ *
+ * @param batch   Пачка после batchRun().
+ * @param lane    Номер поля.
+ * @param base    Поле, на которое клались фигуры.
+ * @param weights Веса оценки.
+ * @return Оценка, больше — лучше.
+ */
+float batchScore(const BotBatch_t *batch, int lane, const BotBoard_t *base,
+                 const BotWeights_t *weights) {
+  int lines = base->lines + batch->lines[lane];
+  return weights->holes * batch->holes[lane] +
+         weights->height * batch->aggregate[lane] +
+         weights->bumpiness * batch->bumpiness[lane] +
+         weights->lines * lines +
+         weights->transitions * batch->transitions[lane];
+}
+
+/**
+ * @brief Снимает фигуры с полей пачки: строки, которые они задели,
+ * возвращаются к строкам base.
+ *
+ * @param batch Пачка.
+ * @param base  Поле, переданное batchFill().
+ */
+void batchReset(BotBatch_t *batch, const BotBoard_t *base) {
+  for (int lane = 0; lane < batch->count; lane++) {
+    const Tetromino_t *t = &batch->pieces[lane];
+    const PieceShape_t *s = figureShape(t);
+    for (int y = t->y + s->top; y <= t->y + s->bottom; y++) {
+      batch->rows[y][lane] = base->rows[y];
+    }
+  }
+  batch->count = 0;
+  batch->top = batchTop(base);
+}
+
+/**
+ * @brief Находит лучшую оценку поля после одной из посадок — то же, что
+ * максимум botEvaluate() после botPlace() по всем посадкам, но посадки
+ * оцениваются пачками по BATCH_LANES.
+ *
+ * @param board   Поле.
+ * @param moves   Посадки.
+ * @param n       Число посадок (больше 0).
+ * @param weights Веса оценки.
+ * @return Лучшая оценка.
+ */
+float batchBest(const BotBoard_t *board, const BotPlacement_t *moves, int n,
+                const BotWeights_t *weights) {
+  BotBatch_t batch;
+  float best = 0;
+  batchFill(&batch, board);
+  for (int i = 0; i < n; i += BATCH_LANES) {
+    int end = n - i < BATCH_LANES ? n : i + BATCH_LANES;
+    for (int j = i; j < end; j++) batchAdd(&batch, &moves[j].piece);
+    batchRun(&batch);
+    for (int lane = 0; lane < batch.count; lane++) {
+      float score = batchScore(&batch, lane, board, weights);
+      if ((i == 0 && lane == 0) || score > best) best = score;
+    }
+    batchReset(&batch, board);
+  }
+  return best;
+}
@@ -0,0 +1,47 @@
+#ifndef BATCH_H
+#define BATCH_H
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "bot.h"
+
+#define BATCH_ALIGN 64
+/** Полей в пачке: строка y всех полей пачки занимает одну кеш-линию. */
+#define BATCH_LANES (BATCH_ALIGN / (int)sizeof(Row_t))
+
+/** Набор инструкций ядра признаков пачки. */
+typedef enum { BATCH_SCALAR, BATCH_SSE, BATCH_AVX2 } BatchIsa_t;
+
+/**
+ * Пачка полей для оценки одним проходом: строки BATCH_LANES полей лежат
+ * рядом (структура массивов), rows[y][lane] — строка y поля lane, поэтому
+ * ядро SSE или AVX2 обрабатывает строку нескольких полей одной инструкцией.
+ * Поля пачки — одно поле base с разными фигурами pieces, положенными без
+ * очистки линий; ядро считает признаки так, будто заполненные строки уже
+ * очищены. Строки выше top пусты во всех полях, и ядро их не читает.
+ * Счётчики имеют ширину строки, чтобы ядро сохраняло их целым регистром.
+ */
+typedef struct BotBatch_t {
+  _Alignas(BATCH_ALIGN) Row_t rows[FIELD_HEIGHT][BATCH_LANES];
+  _Alignas(BATCH_ALIGN) Row_t aggregate[BATCH_LANES];
+  _Alignas(BATCH_ALIGN) Row_t holes[BATCH_LANES];
+  _Alignas(BATCH_ALIGN) Row_t bumpiness[BATCH_LANES];
+  _Alignas(BATCH_ALIGN) Row_t transitions[BATCH_LANES];
+  _Alignas(BATCH_ALIGN) Row_t lines[BATCH_LANES];
+  Tetromino_t pieces[BATCH_LANES];
+  int count;
+  int top;
+} BotBatch_t;
+
+BatchIsa_t batchIsa(void);
+bool batchSelect(BatchIsa_t isa);
+void batchFill(BotBatch_t *batch, const BotBoard_t *base);
+void batchAdd(BotBatch_t *batch, const Tetromino_t *t);
+void batchRun(BotBatch_t *batch);
+float batchScore(const BotBatch_t *batch, int lane, const BotBoard_t *base,
+                 const BotWeights_t *weights);
+void batchReset(BotBatch_t *batch, const BotBoard_t *base);
+float batchBest(const BotBoard_t *board, const BotPlacement_t *moves, int n,
+                const BotWeights_t *weights);
+
+#endif
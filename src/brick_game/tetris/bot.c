@@ -0,0 +1,544 @@
+#include "bot.h"
+
+#include "batch.h"
+
+/** Веса по умолчанию (подобраны генетическим поиском для поля 10x20). */
+const BotWeights_t bot_default_weights = {-0.35663f, -0.510066f, -0.184483f,
+                                          0.760666f, 0.0f};
+
+/** Вклад отрезка столбцов в признаки поля. */
+typedef struct BotTerms_t {
+  int aggregate, holes, bumpiness;
+} BotTerms_t;
+
+/**
+ * @brief Считает вклад столбцов [lo..hi] в сумму высот и дырки и вклад
+ * перепадов, в которых участвует хотя бы один из них.
+ *
+ * @param board Поле.
+ * @param lo    Левый столбец.
+ * @param hi    Правый столбец.
+ * @return Вклад отрезка.
+ */
+static BotTerms_t spanTerms(const BotBoard_t *board, int lo, int hi) {
+  BotTerms_t terms = {0, 0, 0};
+  for (int x = lo; x <= hi; x++) {
+    int height = FIELD_HEIGHT - board->heights[x];
+    terms.aggregate += height;
+    terms.holes += height - board->filled[x];
+  }
+  int from = lo > 0 ? lo - 1 : 0;
+  int to = hi < FIELD_WIDTH - 1 ? hi : FIELD_WIDTH - 2;
+  for (int x = from; x <= to; x++) {
+    int d = board->heights[x] - board->heights[x + 1];
+    terms.bumpiness += d < 0 ? -d : d;
+  }
+  return terms;
+}
+
+/**
+ * @brief Пересчитывает признаки поля по всем столбцам и строкам.
+ *
+ * @param board Поле.
+ */
+static void recount(BotBoard_t *board) {
+  BotTerms_t terms = spanTerms(board, 0, FIELD_WIDTH - 1);
+  board->aggregate = (int16_t)terms.aggregate;
+  board->holes = (int16_t)terms.holes;
+  board->bumpiness = (int16_t)terms.bumpiness;
+  int transitions = 0;
+  for (int y = 0; y < FIELD_HEIGHT; y++) {
+    transitions += botRowTransitions(board->rows[y]);
+  }
+  board->transitions = (int16_t)transitions;
+}
+
+/**
+ * @brief Строит поле перебора по контексту игры. Падающая фигура в поле не
+ * входит.
+ *
+ * @param board Поле.
+ * @param gc    Указатель на контекст игры.
+ */
+void botBoardInit(BotBoard_t *board, const GameContext_t *gc) {
+  memcpy(board->rows, gc->rows, sizeof(board->rows));
+  const Tetromino_t *t = &gc->current;
+  if ((gc->state == STATE_FALLING || gc->state == STATE_PAUSED) &&
+      figureInBounds(t)) {
+    const PieceShape_t *s = figureShape(t);
+    for (int i = 0; i < FIGURE_SIZE; i++) {
+      Row_t piece = pieceRow(s, i, t->x + s->left);
+      board->rows[t->y + s->top + i] &= (Row_t)~piece;
+    }
+  }
+  memcpy(board->heights, gc->heights, sizeof(board->heights));
+  memset(board->filled, 0, sizeof(board->filled));
+  for (int y = 0; y < FIELD_HEIGHT; y++) {
+    for (Row_t row = board->rows[y]; row; row &= (Row_t)(row - 1)) {
+      board->filled[__builtin_ctzll(row)]++;
+    }
+  }
+  board->lines = 0;
+  board->hash = rowsKey(board->rows, 0, FIELD_HEIGHT);
+  recount(board);
+}
+
+/**
+ * @brief Проверяет, помещается ли фигура на поле в своём положении.
+ *
+ * @param board Поле.
+ * @param t     Фигура.
+ * @return 1, если фигура в пределах поля и не задевает занятых клеток.
+ */
+int botFits(const BotBoard_t *board, const Tetromino_t *t) {
+  const PieceShape_t *s = figureShape(t);
+  return figureInBounds(t) &&
+         !pieceHits(&board->rows[t->y + s->top], s, t->x + s->left);
+}
+
+/**
+ * @brief Находит первый поворот фигуры с той же маской, что у поворота r.
+ * Повороты с одной маской при одинаковом положении рамки занимают одни и
+ * те же клетки.
+ *
+ * @param piece    Фигура.
+ * @param rotation Поворот.
+ * @return Наименьший поворот с той же маской.
+ */
+static int sameRotation(int piece, int rotation) {
+  const PieceShape_t *shapes = tetromino_table[piece];
+  int same = rotation;
+  for (int j = rotation - 1; j >= 0; j--) {
+    if (shapes[j].mask == shapes[rotation].mask) same = j;
+  }
+  return same;
+}
+
+/**
+ * @brief Строит строку карты допустимых положений: бит c поднят, если
+ * фигура с рамкой 4x4 на строке y и левым краем рамки фигуры в столбце c
+ * лежит в поле и не задевает занятых клеток. Строка собирается из четырёх
+ * сдвигов строк поля — по одному на клетку фигуры.
+ *
+ * @param board Поле.
+ * @param s     Положение фигуры.
+ * @param y     Строка рамки 4x4 (Tetromino_t.y).
+ * @return Строка карты.
+ */
+static Row_t fitRow(const BotBoard_t *board, const PieceShape_t *s, int y) {
+  Row_t fits = 0;
+  int ty = y + s->top;
+  if (ty >= 0 && ty < FIELD_HEIGHT - (s->bottom - s->top)) {
+    Row_t blocked = 0;
+    for (int i = 0; i < FIGURE_SIZE; i++) {
+      blocked |= (Row_t)(board->rows[y + s->cells[i][0]] >>
+                         (s->cells[i][1] - s->left));
+    }
+    fits = (Row_t)(FULL_ROW >> (s->right - s->left)) & (Row_t)~blocked;
+  }
+  return fits;
+}
+
+/**
+ * @brief Возвращает строку, выше которой рамка 4x4 не задевает стопку.
+ *
+ * @param board Поле.
+ * @return Наибольшая строка рамки, целиком лежащая над стопкой (может быть
+ * отрицательной).
+ */
+static int skyRow(const BotBoard_t *board) {
+  int top = FIELD_HEIGHT;
+  for (int x = 0; x < FIELD_WIDTH; x++) {
+    if (board->heights[x] < top) top = board->heights[x];
+  }
+  return top - FIGURE_SIZE;
+}
+
+/**
+ * @brief Строит карты допустимых положений фигуры во всех поворотах по
+ * строке верха фигуры: fits[r][ty] = fitRow() для рамки на ty - top. Над
+ * стопкой свободны все положения, а повороты с одной маской имеют одну и
+ * ту же карту, поэтому fitRow() считается только для остальных строк
+ * первого поворота с каждой маской.
+ *
+ * @param      board Поле.
+ * @param      piece Фигура.
+ * @param[out] fits  Карты положений.
+ */
+static void fitMaps(const BotBoard_t *board, int piece,
+                    Row_t fits[ROTATION_COUNT][FIELD_HEIGHT]) {
+  int sky = skyRow(board);
+  for (int r = 0; r < ROTATION_COUNT; r++) {
+    const PieceShape_t *s = &tetromino_table[piece][r];
+    int same = sameRotation(piece, r);
+    if (same != r) {
+      memcpy(fits[r], fits[same], sizeof(fits[r]));
+    } else {
+      Row_t range = (Row_t)(FULL_ROW >> (s->right - s->left));
+      for (int ty = 0; ty < FIELD_HEIGHT; ty++) {
+        fits[r][ty] = ty <= sky ? range : fitRow(board, s, ty - s->top);
+      }
+    }
+  }
+}
+
+/**
+ * @brief Замыкает множество столбцов по сдвигам влево и вправо внутри
+ * допустимых: за шаг множество расширяется на столбец в обе стороны.
+ *
+ * @param m Исходные столбцы (подмножество f).
+ * @param f Допустимые столбцы.
+ * @return Столбцы, достижимые из m без выхода из f.
+ */
+static Row_t rowClosure(Row_t m, Row_t f) {
+  for (Row_t prev = 0; prev != m;) {
+    prev = m;
+    m |= (Row_t)((Row_t)(m << 1) | (Row_t)(m >> 1)) & f;
+  }
+  return m;
+}
+
+/**
+ * @brief Сдвигает строку столбцов левого края рамки фигуры при повороте из
+ * r в следующий: рамка 4x4 на месте, меняется отступ фигуры в ней.
+ *
+ * @param m     Столбцы в повороте r.
+ * @param from  Положение фигуры до поворота.
+ * @param to    Положение фигуры после поворота.
+ * @return Столбцы в следующем повороте.
+ */
+static Row_t turnRow(Row_t m, const PieceShape_t *from,
+                     const PieceShape_t *to) {
+  int d = to->left - from->left;
+  return (Row_t)(d >= 0 ? m << d : m >> -d);
+}
+
+/**
+ * @brief Перечисляет все различные положения, в которых фигура может
+ * зафиксироваться, если вести её из положения from по правилам
+ * fallingHandler: Left и Right сдвигают на клетку, Action поворачивает без
+ * отскоков, Up опускает на строку, недопустимый ход не выполняется. Так
+ * находятся и подсовы под нависания, и повороты у дна.
+ *
+ * Поворот и сдвиги не меняют строку рамки 4x4, а вниз фигура только
+ * падает, поэтому строки рамки обходятся сверху вниз за один проход. В
+ * строке достижимые столбцы каждого поворота замыкаются по сдвигам
+ * (rowClosure()) и поворотам, пока повороты добавляют новые; в следующую
+ * строку переходит то, что может опуститься, а остальное фиксируется.
+ * Повороты с одной маской сливаются в первый из них.
+ *
+ * @param      board Поле.
+ * @param      from  Исходное положение фигуры.
+ * @param[out] out   Положения фиксации, не больше BOT_MAX_PLACEMENTS.
+ * @return Число положений; 0, если фигура не помещается в исходном.
+ */
+int botPlacements(const BotBoard_t *board, const Tetromino_t *from,
+                  BotPlacement_t *out) {
+  int count = 0;
+  if (botFits(board, from)) {
+    const PieceShape_t *shapes = tetromino_table[from->piece];
+    Row_t fits[ROTATION_COUNT][FIELD_HEIGHT];
+    Row_t lock[ROTATION_COUNT][FIELD_HEIGHT];
+    Row_t fit[ROTATION_COUNT], reach[ROTATION_COUNT] = {0};
+    int same[ROTATION_COUNT];
+    int sky = skyRow(board);
+    fitMaps(board, from->piece, fits);
+    memset(lock, 0, sizeof(lock));
+    for (int r = 0; r < ROTATION_COUNT; r++) {
+      same[r] = sameRotation(from->piece, r);
+      fit[r] = fits[r][from->y + shapes[r].top];
+    }
+    reach[from->rotation] =
+        (Row_t)((Row_t)1 << (from->x + shapes[from->rotation].left));
+    bool alive = true;
+    for (int y = from->y; alive; y++) {
+      for (int r = 0; r < ROTATION_COUNT; r++) {
+        reach[r] = rowClosure(reach[r], fit[r]);
+      }
+      for (int r = 0, idle = 0; idle < ROTATION_COUNT;) {
+        int next = (r + 1) % ROTATION_COUNT;
+        Row_t turned = turnRow(reach[r], &shapes[r], &shapes[next]) & fit[next];
+        if (turned & (Row_t)~reach[next]) {
+          reach[next] = rowClosure(reach[next] | turned, fit[next]);
+          idle = 0;
+        } else {
+          idle++;
+        }
+        r = next;
+      }
+      bool open = y + 1 < sky;
+      for (int r = 0; r < ROTATION_COUNT; r++) open &= reach[r] == fit[r];
+      /* Над стопкой из любого положения достижимо любое, и строки до
+       * последней такой строки повторяют текущую. */
+      if (open) y = sky - 1;
+      alive = false;
+      for (int r = 0; r < ROTATION_COUNT; r++) {
+        int ty = y + 1 + shapes[r].top;
+        fit[r] = ty < FIELD_HEIGHT ? fits[r][ty] : 0;
+        Row_t stop = reach[r] & (Row_t)~fit[r];
+        if (stop) lock[same[r]][ty - 1] |= stop;
+        reach[r] &= fit[r];
+        alive |= reach[r] != 0;
+      }
+    }
+    for (int r = 0; r < ROTATION_COUNT; r++) {
+      for (int ty = 0; same[r] == r && ty < FIELD_HEIGHT; ty++) {
+        for (Row_t m = lock[r][ty]; m; m &= (Row_t)(m - 1)) {
+          Tetromino_t *t = &out[count++].piece;
+          t->piece = from->piece;
+          t->rotation = (int8_t)r;
+          t->x = (int8_t)(__builtin_ctzll(m) - shapes[r].left);
+          t->y = (int8_t)(ty - shapes[r].top);
+        }
+      }
+    }
+  }
+  return count;
+}
+
+/**
+ * @brief Кладёт фигуру на поле, очищает заполненные линии и обновляет
+ * признаки. Без очистки пересчитываются только столбцы фигуры и их соседи;
+ * после очистки — всё поле.
+ *
+ * @param board Поле.
+ * @param t     Фигура в точке приземления.
+ */
+void botPlace(BotBoard_t *board, const Tetromino_t *t) {
+  const PieceShape_t *s = figureShape(t);
+  int lo = t->x + s->left;
+  int hi = t->x + s->right;
+  BotTerms_t before = spanTerms(board, lo, hi);
+  int top = t->y + s->top;
+  int span = s->bottom - s->top + 1;
+  uint64_t full = 0;
+  board->hash ^= rowsKey(&board->rows[top], top, span);
+  for (int i = 0; i < span; i++) {
+    board->transitions -= botRowTransitions(board->rows[top + i]);
+    board->rows[top + i] |= pieceRow(s, i, lo);
+    board->transitions += botRowTransitions(board->rows[top + i]);
+    full |= (uint64_t)(board->rows[top + i] == FULL_ROW) << (top + i);
+  }
+  board->hash ^= rowsKey(&board->rows[top], top, span);
+  for (int i = 0; i < FIGURE_SIZE; i++) {
+    int y = t->y + s->cells[i][0];
+    int x = t->x + s->cells[i][1];
+    board->filled[x]++;
+    if (y < board->heights[x]) board->heights[x] = (int8_t)y;
+  }
+  if (!full) {
+    BotTerms_t after = spanTerms(board, lo, hi);
+    board->aggregate += (int16_t)(after.aggregate - before.aggregate);
+    board->holes += (int16_t)(after.holes - before.holes);
+    board->bumpiness += (int16_t)(after.bumpiness - before.bumpiness);
+  } else {
+    int counter = 0;
+    int row = 63 - __builtin_clzll(full);
+    while (row >= 0) {
+      counter++;
+      uint64_t above = full & ((1ull << row) - 1);
+      int next = above ? 63 - __builtin_clzll(above) : -1;
+      memmove(&board->rows[next + 1 + counter], &board->rows[next + 1],
+              (size_t)(row - 1 - next) * sizeof(Row_t));
+      row = next;
+    }
+    memset(board->rows, 0, (size_t)counter * sizeof(Row_t));
+    /* Полная строка занята во всех столбцах, поэтому пустых среди них нет. */
+    for (int x = 0; x < FIELD_WIDTH; x++) {
+      board->filled[x] = (int8_t)(board->filled[x] - counter);
+      int column = board->heights[x] + counter;
+      if (full >> board->heights[x] & 1) {
+        while (column < FIELD_HEIGHT && !(board->rows[column] >> x & 1)) {
+          column++;
+        }
+      }
+      board->heights[x] = (int8_t)column;
+    }
+    board->lines = (int16_t)(board->lines + counter);
+    board->hash = rowsKey(board->rows, 0, FIELD_HEIGHT);
+    recount(board);
+  }
+}
+
+/**
+ * @brief Оценивает поле линейной функцией признаков.
+ *
+ * @param board   Поле.
+ * @param weights Веса признаков.
+ * @return Оценка, больше — лучше.
+ */
+float botEvaluate(const BotBoard_t *board, const BotWeights_t *weights) {
+  return weights->holes * board->holes + weights->height * board->aggregate +
+         weights->bumpiness * board->bumpiness + weights->lines * board->lines +
+         weights->transitions * board->transitions;
+}
+
+/**
+ * @brief Выбирает посадку падающей фигуры с просмотром следующей: каждая
+ * посадка текущей фигуры оценивается лучшей посадкой следующей из точки
+ * спавна. Если после посадки следующей фигуре некуда появиться, посадка
+ * проигрышная и выбирается, только когда других нет.
+ *
+ * @param      gc      Указатель на контекст игры (STATE_FALLING).
+ * @param      weights Веса оценки.
+ * @param[out] best    Лучшая посадка.
+ * @return 1, если посадка найдена; 0 — фигура не падает или ей некуда идти.
+ */
+int botChoose(const GameContext_t *gc, const BotWeights_t *weights,
+              BotPlacement_t *best) {
+  BotPlacement_t first[BOT_MAX_PLACEMENTS];
+  BotPlacement_t second[BOT_MAX_PLACEMENTS];
+  BotBoard_t root;
+  botBoardInit(&root, gc);
+  int n = gc->state == STATE_FALLING
+              ? botPlacements(&root, &gc->current, first)
+              : 0;
+  Tetromino_t spawn = {(int8_t)gc->next_piece, 0, SPAWN_X, SPAWN_Y};
+  float best_score = 0;
+  int best_alive = 0;
+  for (int i = 0; i < n; i++) {
+    BotBoard_t after = root;
+    botPlace(&after, &first[i].piece);
+    int m = botPlacements(&after, &spawn, second);
+    float score = m > 0 ? batchBest(&after, second, m, weights)
+                        : botEvaluate(&after, weights);
+    int alive = m > 0;
+    if (i == 0 || alive > best_alive ||
+        (alive == best_alive && score > best_score)) {
+      best_score = score;
+      best_alive = alive;
+      *best = first[i];
+    }
+  }
+  return n > 0;
+}
+
+/**
+ * @brief Находит кратчайшую последовательность действий, которая приводит
+ * фигуру из положения from к фиксации в положении placement: поиск в
+ * ширину по положениям (поворот, строка, столбец) с теми же ходами, что в
+ * botPlacements(), и завершающий Down. Родитель каждого положения хранится,
+ * чтобы восстановить путь.
+ *
+ * @param      board     Поле.
+ * @param      from      Исходное положение фигуры.
+ * @param      placement Положение фиксации из botPlacements().
+ * @param[out] steps     Действия, не больше BOT_MAX_STEPS.
+ * @return Число действий; 0, если положение недостижимо.
+ */
+int botSteps(const BotBoard_t *board, const Tetromino_t *from,
+             const BotPlacement_t *placement, UserAction_t *steps) {
+  enum { STATES = ROTATION_COUNT * FIELD_HEIGHT * FIELD_WIDTH };
+  static const UserAction_t moves[] = {Action, Left, Right, Up};
+  Row_t fits[ROTATION_COUNT][FIELD_HEIGHT];
+  int16_t parent[STATES];
+  uint8_t via[STATES];
+  int16_t queue[STATES];
+  int count = 0;
+  int piece = from->piece;
+  const PieceShape_t *goal = figureShape(&placement->piece);
+  int goal_ty = placement->piece.y + goal->top;
+  int goal_c = placement->piece.x + goal->left;
+  if (botFits(board, from)) {
+    fitMaps(board, piece, fits);
+    /* Down приводит к цели из столбца goal_c на строках [goal_from..goal_ty]
+     * поворотов с маской цели. */
+    Row_t bit = (Row_t)((Row_t)1 << goal_c);
+    int goal_from = goal_ty + 1;
+    bool lands = goal_ty + 1 >= FIELD_HEIGHT ||
+                 !(fits[placement->piece.rotation][goal_ty + 1] & bit);
+    while (lands && goal_from > 0 &&
+           (fits[placement->piece.rotation][goal_from - 1] & bit)) {
+      goal_from--;
+    }
+    memset(parent, 0xff, sizeof(parent));
+    const PieceShape_t *s = figureShape(from);
+    int head = 0, tail = 0;
+    int found = -1;
+    int first = (from->rotation * FIELD_HEIGHT + from->y + s->top) *
+                    FIELD_WIDTH +
+                from->x + s->left;
+    parent[first] = (int16_t)first;
+    queue[tail++] = (int16_t)first;
+    while (found < 0 && head < tail) {
+      int state = queue[head++];
+      int c = state % FIELD_WIDTH;
+      int ty = state / FIELD_WIDTH % FIELD_HEIGHT;
+      int r = state / (FIELD_WIDTH * FIELD_HEIGHT);
+      s = &tetromino_table[piece][r];
+      if (s->mask == goal->mask && c == goal_c && ty >= goal_from &&
+          ty <= goal_ty) {
+        found = state;
+      }
+      for (int k = 0; found < 0 && k < 4; k++) {
+        int nr = r, nt = ty, nc = c;
+        if (moves[k] == Action) {
+          nr = (r + 1) % ROTATION_COUNT;
+          nt = ty + tetromino_table[piece][nr].top - s->top;
+          nc = c + tetromino_table[piece][nr].left - s->left;
+        } else if (moves[k] != Up) {
+          nc = c + (moves[k] == Left ? -1 : 1);
+        } else {
+          nt = ty + 1;
+        }
+        if (nt < 0 || nt >= FIELD_HEIGHT || nc < 0 || nc >= FIELD_WIDTH ||
+            !(fits[nr][nt] >> nc & 1)) {
+          continue;
+        }
+        int next = (nr * FIELD_HEIGHT + nt) * FIELD_WIDTH + nc;
+        if (parent[next] < 0) {
+          parent[next] = (int16_t)state;
+          via[next] = (uint8_t)moves[k];
+          queue[tail++] = (int16_t)next;
+        }
+      }
+    }
+    if (found >= 0) {
+      for (int state = found; state != first; state = parent[state]) {
+        count++;
+      }
+      steps[count] = Down;
+      for (int state = found, i = count - 1; i >= 0; i--) {
+        steps[i] = (UserAction_t)via[state];
+        state = parent[state];
+      }
+      count++;
+    }
+  }
+  return count;
+}
+
+/**
+ * @brief Играет ботом без интерфейса и таймеров: Start, затем для каждой
+ * появившейся фигуры botChoose() и botSteps(), пока игра не кончится или не
+ * появится max_pieces фигур. Исход зависит только от зерна контекста и
+ * весов.
+ *
+ * @param gc         Указатель на контекст игры (засеянный, STATE_START).
+ * @param weights    Веса оценки.
+ * @param max_pieces Наибольшее число фигур.
+ * @return Число появившихся фигур.
+ */
+long botPlay(GameContext_t *gc, const BotWeights_t *weights, long max_pieces) {
+  UserAction_t steps[BOT_MAX_STEPS];
+  int count = 0, pos = 0;
+  long pieces = 0;
+  stepContext(gc, Start, false);
+  while (gc->state != STATE_GAME_OVER && pieces < max_pieces) {
+    TetrisState_t before = gc->state;
+    UserAction_t action = Up;
+    if (gc->state == STATE_FALLING) action = pos < count ? steps[pos++] : Down;
+    stepContext(gc, action, false);
+    if (before == STATE_SPAWN && gc->state == STATE_FALLING) {
+      BotPlacement_t best;
+      BotBoard_t board;
+      pieces++;
+      pos = count = 0;
+      if (botChoose(gc, weights, &best)) {
+        botBoardInit(&board, gc);
+        count = botSteps(&board, &gc->current, &best, steps);
+      }
+    }
+  }
+  return pieces;
+}
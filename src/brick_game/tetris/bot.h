@@ -0,0 +1,87 @@
+#ifndef BOT_H
+#define BOT_H
+#include <stdint.h>
+
+#include "backend.h"
+
+/**
+ * Наибольшее число посадок одной фигуры. Две точки фиксации в одном
+ * повороте и столбце разделены хотя бы одной свободной строкой.
+ */
+#define BOT_MAX_PLACEMENTS \
+  (ROTATION_COUNT * FIELD_WIDTH * ((FIELD_HEIGHT + 1) / 2))
+/** Наибольшая длина плана: обход всех положений фигуры и сброс. */
+#define BOT_MAX_STEPS (ROTATION_COUNT * FIELD_WIDTH * FIELD_HEIGHT + 1)
+
+/**
+ * Веса линейной оценки поля. Оценка — сумма признаков с весами: закрытые
+ * сверху пустые клетки, сумма высот столбцов, сумма перепадов соседних
+ * столбцов, число очищенных линий и переходы в строках — смены занятой и
+ * пустой клетки вдоль каждой строки, стенки считаются занятыми. Больше —
+ * лучше.
+ */
+typedef struct BotWeights_t {
+  float holes;
+  float height;
+  float bumpiness;
+  float lines;
+  float transitions;
+} BotWeights_t;
+
+extern const BotWeights_t bot_default_weights;
+
+/**
+ * Поле для перебора: битборд без цветов и признаки оценки, которые
+ * обновляются при каждой посадке только по задетым столбцам. heights — как
+ * в GameContext_t (FIELD_HEIGHT — столбец пуст), filled — число занятых
+ * клеток столбца, lines — линии, очищенные всеми посадками с начала
+ * перебора, transitions — переходы во всех строках поля, hash — хеш
+ * Зобриста занятости, как GameContext_t.hash.
+ * Структура плоская: ветвь перебора — её копия.
+ */
+typedef struct BotBoard_t {
+  Row_t rows[FIELD_HEIGHT + FIGURE_SIZE];
+  uint64_t hash;
+  int8_t heights[FIELD_WIDTH];
+  int8_t filled[FIELD_WIDTH];
+  int16_t aggregate;
+  int16_t holes;
+  int16_t bumpiness;
+  int16_t transitions;
+  int16_t lines;
+} BotBoard_t;
+
+/**
+ * Посадка фигуры: положение, в котором она фиксируется. Путь к нему из
+ * исходного положения строит botSteps().
+ */
+typedef struct BotPlacement_t {
+  Tetromino_t piece;
+} BotPlacement_t;
+
+/**
+ * @brief Считает переходы в строке: смены занятой и пустой клетки между
+ * соседними столбцами и у стенок, которые считаются занятыми. Пустая
+ * строка даёт 2.
+ *
+ * @param row Строка поля.
+ * @return Число переходов.
+ */
+static inline int botRowTransitions(Row_t row) {
+  Row_t edges = (Row_t)(row ^ (Row_t)((Row_t)(row << 1) | 1u)) & FULL_ROW;
+  return __builtin_popcountll(edges) + !(row >> (FIELD_WIDTH - 1) & 1);
+}
+
+void botBoardInit(BotBoard_t *board, const GameContext_t *gc);
+int botFits(const BotBoard_t *board, const Tetromino_t *t);
+int botPlacements(const BotBoard_t *board, const Tetromino_t *from,
+                  BotPlacement_t *out);
+void botPlace(BotBoard_t *board, const Tetromino_t *t);
+float botEvaluate(const BotBoard_t *board, const BotWeights_t *weights);
+int botChoose(const GameContext_t *gc, const BotWeights_t *weights,
+              BotPlacement_t *best);
+int botSteps(const BotBoard_t *board, const Tetromino_t *from,
+             const BotPlacement_t *placement, UserAction_t *steps);
+long botPlay(GameContext_t *gc, const BotWeights_t *weights, long max_pieces);
+
+#endif
@@ -0,0 +1,91 @@
+#include "frame.h"
+
+/**
+ * @brief Инициализирует тройной буфер: кадры пусты, задний кадр — 0, средний
+ * — 1, передний — 2.
+ *
+ * @param fb Указатель на буфер кадров.
+ */
+void frameBufferInit(FrameBuffer_t *fb) {
+  memset(fb->frames, 0, sizeof(fb->frames));
+  fb->back = 0;
+  fb->sequence = 0;
+  fb->front = 2;
+  atomic_init(&fb->middle, 1u);
+}
+
+/**
+ * @brief Возвращает задний кадр писателя. Читатель его не видит, пока он не
+ * опубликован.
+ *
+ * @param fb Указатель на буфер кадров.
+ * @return Кадр для заполнения.
+ */
+Frame_t *frameBegin(FrameBuffer_t *fb) { return &fb->frames[fb->back]; }
+
+/**
+ * @brief Публикует заполненный задний кадр: присваивает ему очередной номер и
+ * меняет местами со средним. Прежний средний кадр, если читатель его не
+ * забрал, становится новым задним и будет перезаписан.
+ *
+ * @param fb Указатель на буфер кадров.
+ */
+void framePublish(FrameBuffer_t *fb) {
+  fb->frames[fb->back].sequence = ++fb->sequence;
+  unsigned old = atomic_exchange_explicit(&fb->middle, fb->back | FRAME_FRESH,
+                                          memory_order_acq_rel);
+  fb->back = old & ~FRAME_FRESH;
+}
+
+/**
+ * @brief Возвращает последний полностью опубликованный кадр. Если с прошлого
+ * вызова вышел новый кадр, читатель обменивает на него свой передний; иначе
+ * возвращается тот же кадр. Кадр остаётся неизменным до следующего вызова.
+ *
+ * @param fb Указатель на буфер кадров.
+ * @return Кадр для отрисовки (sequence == 0 — публикаций ещё не было).
+ */
+const Frame_t *frameAcquire(FrameBuffer_t *fb) {
+  if (atomic_load_explicit(&fb->middle, memory_order_relaxed) & FRAME_FRESH) {
+    unsigned old = atomic_exchange_explicit(&fb->middle, fb->front,
+                                            memory_order_acq_rel);
+    fb->front = old & ~FRAME_FRESH;
+  }
+  return &fb->frames[fb->front];
+}
+
+/**
+ * @brief Заполняет кадр по состоянию контекста: поле с падающей фигурой, её
+ * тень, следующую фигуру и статистику.
+ *
+ * @param gc    Указатель на контекст игры.
+ * @param frame Кадр.
+ */
+void captureFrame(const GameContext_t *gc, Frame_t *frame) {
+  memcpy(frame->field, gc->cells, sizeof(frame->field));
+  memcpy(frame->next, gc->preview, sizeof(frame->next));
+  int ghost[FIGURE_SIZE][2];
+  frame->ghost_count = (uint8_t)ghostCells(gc, ghost);
+  for (int i = 0; i < frame->ghost_count; i++) {
+    frame->ghost[i][0] = (int8_t)ghost[i][0];
+    frame->ghost[i][1] = (int8_t)ghost[i][1];
+  }
+  frame->hint_count = 0;
+  frame->state = (uint8_t)gc->state;
+  frame->score = gc->info.score;
+  frame->high_score = gc->info.high_score;
+  frame->level = gc->info.level;
+  frame->speed = gc->info.speed;
+  frame->pause = gc->info.pause;
+}
+
+/**
+ * @brief Снимает кадр с контекста и публикует его.
+ *
+ * @param gc Указатель на контекст игры.
+ * @param fb Указатель на буфер кадров.
+ */
+void publishContext(const GameContext_t *gc, FrameBuffer_t *fb) {
+  captureFrame(gc, frameBegin(fb));
+  framePublish(fb);
+}
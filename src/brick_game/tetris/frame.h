@@ -0,0 +1,57 @@
+#ifndef FRAME_H
+#define FRAME_H
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "backend.h"
+
+#define FRAME_COUNT 3
+#define FRAME_ALIGN 64
+
+/**
+ * Неизменяемый кадр для отрисовки: всё, что нужно фронтенду, без указателей
+ * на буферы движка. sequence — номер публикации (0 — кадр ещё не
+ * публиковался). Поля input* заполняет публикующая сторона, если меряет
+ * задержку ввода: число применённых действий и сумма моментов их нажатия с
+ * начала игры, момент самого раннего действия после прошлого кадра. hint —
+ * клетки подсказанной посадки, если её заполняет публикующая сторона.
+ */
+typedef struct Frame_t {
+  _Alignas(FRAME_ALIGN) uint64_t sequence;
+  uint8_t field[FIELD_HEIGHT][FIELD_WIDTH];
+  uint8_t next[FIGURE_SIZE][FIGURE_SIZE];
+  int8_t ghost[FIGURE_SIZE][2];
+  uint8_t ghost_count;
+  int8_t hint[FIGURE_SIZE][2];
+  uint8_t hint_count;
+  uint8_t state;
+  int32_t score, high_score, level, speed, pause;
+  uint64_t inputs;
+  int64_t input_sum_us, input_first_us;
+} Frame_t;
+
+/**
+ * Тройной буфер кадров. Писатель заполняет свой задний кадр и атомарно
+ * обменивает его со средним; читатель так же забирает средний кадр, если тот
+ * свежее его переднего. Ни одна сторона не ждёт другую и не копирует кадры:
+ * каждым кадром в любой момент владеет ровно одна из сторон. middle хранит
+ * индекс среднего кадра и флаг FRAME_FRESH.
+ */
+typedef struct FrameBuffer_t {
+  Frame_t frames[FRAME_COUNT];
+  _Alignas(FRAME_ALIGN) atomic_uint middle;
+  _Alignas(FRAME_ALIGN) unsigned back;
+  uint64_t sequence;
+  _Alignas(FRAME_ALIGN) unsigned front;
+} FrameBuffer_t;
+
+#define FRAME_FRESH 4u
+
+void frameBufferInit(FrameBuffer_t *fb);
+Frame_t *frameBegin(FrameBuffer_t *fb);
+void framePublish(FrameBuffer_t *fb);
+const Frame_t *frameAcquire(FrameBuffer_t *fb);
+void captureFrame(const GameContext_t *gc, Frame_t *frame);
+void publishContext(const GameContext_t *gc, FrameBuffer_t *fb);
+
+#endif
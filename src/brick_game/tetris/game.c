@@ -7,23 +7,23 @@
  * логики.
  *
  * @param action Тип действия пользователя (движение, вращение, пауза и т.д.).
- * @param hold   Флаг удержания кнопки (в текущей реализации не используется).
+ * @param hold   Флаг удержания кнопки.
  */
 void userInput(UserAction_t action, bool hold) {
-  (void)hold;
-  userInputHandler(action);
+  stepContext(getContext(), action, hold);
 }
 
 /**
  * @brief Возвращает актуальную информацию об игровом состоянии.
  *
- * Эта функция запрашивает контекст игры и возвращает структуру GameInfo_t,
- * содержащую текущий счёт, уровень, скорость, состояние паузы, поле и прочие
- * параметры.
+ * Эта функция запрашивает контекст игры по умолчанию и возвращает структуру
+ * GameInfo_t, содержащую текущий счёт, уровень, скорость, состояние паузы, поле
+ * и прочие параметры. Поле и предпросмотр в int лежат в статическом буфере и
+ * обновляются при каждом вызове.
  *
  * @return Текущая информация об игре (GameInfo_t).
  */
 GameInfo_t updateCurrentState() {
-  const GameContext_t *gc = getContext();
-  return gc->info;
+  static InfoView_t view;
+  return queryContext(getContext(), &view);
 }
\ No newline at end of file
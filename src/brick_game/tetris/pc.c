@@ -0,0 +1,361 @@
+#include "pc.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Один поиск: фигуры pieces[0, count) кладутся в зону из zone нижних строк
+ * и должны заполнить её целиком. reach[i] и parity[i] — границы чётности
+ * для фигур pieces[i, count) (см. pcFeasible()). stopped — исчерпан
+ * предел узлов.
+ */
+typedef struct PcSearch_t {
+  PcSolver_t *solver;
+  const Tetromino_t *current;
+  const int8_t *pieces;
+  int count;
+  int zone;
+  int reach[PC_MAX_PIECES + 1];
+  int parity[PC_MAX_PIECES + 1];
+  bool stopped;
+  BotPlacement_t *plan;
+} PcSearch_t;
+
+/**
+ * @brief Создаёт решатель с таблицей проигрышных узлов.
+ *
+ * @param max_nodes Предел узлов одного поиска, 0 — без предела.
+ * @return Решатель; NULL, если не хватило памяти.
+ */
+PcSolver_t *pcCreate(long max_nodes) {
+  PcSolver_t *solver = calloc(1, sizeof(PcSolver_t));
+  if (solver) {
+    solver->max_nodes = max_nodes;
+    solver->table = calloc((size_t)1 << PC_TABLE_BITS, sizeof(uint64_t));
+    solver->boards =
+        malloc(PC_MAX_PIECES * BOT_MAX_PLACEMENTS * sizeof(BotBoard_t));
+    if (!solver->table || !solver->boards) {
+      free(solver->table);
+      free(solver->boards);
+      free(solver);
+      solver = NULL;
+    }
+  }
+  return solver;
+}
+
+/**
+ * @brief Освобождает решатель.
+ *
+ * @param solver Решатель (NULL допускается).
+ */
+void pcDestroy(PcSolver_t *solver) {
+  if (solver) {
+    free(solver->table);
+    free(solver->boards);
+    free(solver);
+  }
+}
+
+/**
+ * @brief Находит, насколько фигура меняет разность пустых клеток в чётных
+ * и нечётных столбцах: для каждого поворота — половина разности её клеток
+ * в чётных и нечётных столбцах, со знаком, зависящим от чётности столбца
+ * посадки. I даёт 0 или 2, T — 0 или 1, L и J — всегда 1, O, S и Z — 0.
+ *
+ * @param      piece  Вид фигуры.
+ * @param[out] reach  Наибольший модуль вклада.
+ * @param[out] parity Чётность вклада; -1, если у поворотов она разная.
+ */
+static void pieceParity(int piece, int *reach, int *parity) {
+  *reach = 0;
+  *parity = -2;
+  for (int r = 0; r < ROTATION_COUNT; r++) {
+    const PieceShape_t *s = &tetromino_table[piece][r];
+    int balance = 0;
+    for (int i = 0; i < FIGURE_SIZE; i++) {
+      balance += s->cells[i][1] & 1 ? -1 : 1;
+    }
+    int half = abs(balance) / 2;
+    if (half > *reach) *reach = half;
+    if (*parity == -2) {
+      *parity = half & 1;
+    } else if (*parity != (half & 1)) {
+      *parity = -1;
+    }
+  }
+}
+
+/**
+ * @brief Отсекает поля, которые оставшиеся фигуры заведомо не заполнят.
+ * Обе проверки не зависят от очистки линий, которая сдвигает строки, но
+ * не столбцы:
+ * - клетки фигуры связаны соседством в строке или лежат в одном столбце,
+ *   где между ними только очищенные к её посадке строки. Поэтому столбцы,
+ *   соседние пустые клетки которых не стоят рядом ни в одной строке зоны,
+ *   фигуры не связывают, и пустых клеток в каждой группе связанных
+ *   столбцов должно быть кратно 4;
+ * - разность пустых клеток в чётных и нечётных столбцах должна набираться
+ *   вкладами оставшихся фигур (pieceParity()): по модулю не больше суммы
+ *   их наибольших вкладов и той же чётности, если чётность каждого вклада
+ *   известна.
+ *
+ * @param search Поиск.
+ * @param filled Число занятых клеток каждого столбца; все они в зоне.
+ * @param link   Бит x — столбцы x и x + 1 пусты рядом в какой-то строке.
+ * @param rows   Оставшаяся высота зоны.
+ * @param next   Номер очередной фигуры.
+ * @return false, если очистка невозможна.
+ */
+static bool pcFeasible(const PcSearch_t *search, const int8_t *filled,
+                       Row_t link, int rows, int next) {
+  int group = 0;
+  int balance = 0;
+  for (int x = 0; x < FIELD_WIDTH; x++) {
+    int empty = rows - filled[x];
+    group += empty;
+    balance += x & 1 ? -empty : empty;
+    if (!(link >> x & 1)) {
+      if (group % 4) return false;
+      group = 0;
+    }
+  }
+  int half = balance / 2;
+  return abs(half) <= search->reach[next] &&
+         (search->parity[next] < 0 || ((half - search->parity[next]) & 1) == 0);
+}
+
+/**
+ * @brief Возвращает пары соседних пустых клеток строки: бит x — пусты
+ * столбцы x и x + 1.
+ *
+ * @param row Строка поля.
+ * @return Пары.
+ */
+static Row_t emptyPairs(Row_t row) {
+  Row_t empty = (Row_t)~row & FULL_ROW;
+  return empty & (Row_t)(empty >> 1);
+}
+
+/**
+ * @brief Проверяет посадку до того, как класть фигуру: считает занятые
+ * клетки столбцов, пары пустых клеток и очищаемые линии после неё и
+ * передаёт в pcFeasible(). Очищаемые строки полны и пар не дают.
+ *
+ * @param search Поиск.
+ * @param board  Поле.
+ * @param t      Фигура в точке приземления.
+ * @param next   Номер фигуры после неё.
+ * @return false, если после посадки очистка невозможна.
+ */
+static bool pcFeasibleAfter(const PcSearch_t *search, const BotBoard_t *board,
+                            const Tetromino_t *t, int next) {
+  const PieceShape_t *s = figureShape(t);
+  int8_t filled[FIELD_WIDTH];
+  Row_t rows[FIGURE_SIZE];
+  memcpy(filled, board->filled, sizeof(filled));
+  for (int i = s->top; i <= s->bottom; i++) rows[i] = board->rows[t->y + i];
+  for (int i = 0; i < FIGURE_SIZE; i++) {
+    filled[t->x + s->cells[i][1]]++;
+    rows[s->cells[i][0]] |= (Row_t)((Row_t)1 << (t->x + s->cells[i][1]));
+  }
+  int cleared = 0;
+  Row_t link = 0;
+  for (int i = s->top; i <= s->bottom; i++) {
+    cleared += rows[i] == FULL_ROW;
+    link |= emptyPairs(rows[i]);
+  }
+  int height = search->zone - board->lines;
+  for (int y = FIELD_HEIGHT - height; y < FIELD_HEIGHT; y++) {
+    if (y < t->y + s->top || y > t->y + s->bottom) {
+      link |= emptyPairs(board->rows[y]);
+    }
+  }
+  for (int x = 0; cleared && x < FIELD_WIDTH; x++) filled[x] -= cleared;
+  return pcFeasible(search, filled, link, height - cleared, next);
+}
+
+/**
+ * @brief Возвращает ячейку таблицы для узла: хеш поля, номер фигуры,
+ * высота зоны и номер поиска.
+ *
+ * @param      search Поиск.
+ * @param      board  Поле.
+ * @param      index  Номер очередной фигуры.
+ * @param[out] key    Ненулевой ключ узла.
+ * @return Ячейка таблицы решателя.
+ */
+static uint64_t *pcSlot(const PcSearch_t *search, const BotBoard_t *board,
+                        int index, uint64_t *key) {
+  *key = hashMix(board->hash ^ search->solver->stamp ^
+                 (uint64_t)(index * (FIELD_HEIGHT + 1) + search->zone + 1));
+  if (!*key) *key = 1;
+  return &search->solver->table[*key & (((uint64_t)1 << PC_TABLE_BITS) - 1)];
+}
+
+/**
+ * @brief Проверяет, что узел уже признан проигрышным.
+ *
+ * @param search Поиск.
+ * @param board  Поле.
+ * @param index  Номер очередной фигуры.
+ * @return true, если очистки из узла заведомо нет.
+ */
+static bool pcKnown(const PcSearch_t *search, const BotBoard_t *board,
+                    int index) {
+  uint64_t key;
+  return *pcSlot(search, board, index, &key) == key;
+}
+
+/**
+ * @brief Перебирает посадки фигуры pieces[index] внутри зоны: сначала те,
+ * после которых поле лучше по оценке бота. Проигрышный узел запоминается
+ * в таблице решателя, прерванный предел узлов — нет.
+ *
+ * @param search Поиск; при успехе plan[index, count) заполняется.
+ * @param board  Поле.
+ * @param index  Номер очередной фигуры.
+ * @return true, если поле очищается оставшимися фигурами.
+ */
+static bool pcNode(PcSearch_t *search, const BotBoard_t *board, int index) {
+  if (board->lines == search->zone) return true;
+  if (index == search->count) return false;
+  uint64_t key;
+  uint64_t *slot = pcSlot(search, board, index, &key);
+  if (*slot == key) return false;
+  if (search->solver->max_nodes &&
+      search->solver->nodes == search->solver->max_nodes) {
+    search->stopped = true;
+    return false;
+  }
+  search->solver->nodes++;
+  Tetromino_t spawn = {search->pieces[index], 0, SPAWN_X, SPAWN_Y};
+  const Tetromino_t *from = index ? &spawn : search->current;
+  BotPlacement_t moves[BOT_MAX_PLACEMENTS];
+  int n = botFits(board, from) ? botPlacements(board, from, moves) : 0;
+  int floor = FIELD_HEIGHT - (search->zone - board->lines);
+  BotBoard_t *after = &search->solver->boards[index * BOT_MAX_PLACEMENTS];
+  float score[BOT_MAX_PLACEMENTS];
+  int order[BOT_MAX_PLACEMENTS];
+  int kept = 0;
+  for (int i = 0; i < n; i++) {
+    const Tetromino_t *t = &moves[i].piece;
+    if (t->y + figureShape(t)->top < floor ||
+        !pcFeasibleAfter(search, board, t, index + 1)) {
+      continue;
+    }
+    after[i] = *board;
+    botPlace(&after[i], t);
+    if (pcKnown(search, &after[i], index + 1)) continue;
+    score[i] = botEvaluate(&after[i], &bot_default_weights);
+    int j = kept++;
+    for (; j > 0 && score[order[j - 1]] < score[i]; j--) {
+      order[j] = order[j - 1];
+    }
+    order[j] = i;
+  }
+  bool found = false;
+  for (int k = 0; !found && !search->stopped && k < kept; k++) {
+    found = pcNode(search, &after[order[k]], index + 1);
+    if (found) search->plan[index] = moves[order[k]];
+  }
+  if (!found && !search->stopped) *slot = key;
+  return found;
+}
+
+/**
+ * @brief Ищет полную очистку поля не больше чем за count фигур известной
+ * последовательности. Высота зоны очистки перебирается снизу: от высоты
+ * стопки, и только такие, где пустых клеток зоны кратно 4 — по 4 на
+ * фигуру, поэтому первое найденное решение — самое короткое. Фигуры
+ * кладутся только туда, куда их доводят ходы игры (botPlacements()), и
+ * целиком внутри зоны.
+ *
+ * @param      solver  Решатель.
+ * @param      board   Поле без заполненных строк.
+ * @param      current Текущая фигура в её положении.
+ * @param      pieces  Последовательность фигур; pieces[0] — вид current.
+ * @param      count   Длина последовательности, не больше PC_MAX_PIECES.
+ * @param[out] plan    Посадки решения, по одной на фигуру.
+ * @return Число фигур решения; 0, если очистки нет; -1, если поиск
+ * прерван по пределу узлов.
+ */
+int pcSolve(PcSolver_t *solver, const BotBoard_t *board,
+            const Tetromino_t *current, const int8_t *pieces, int count,
+            BotPlacement_t *plan) {
+  if (count > PC_MAX_PIECES) count = PC_MAX_PIECES;
+  solver->nodes = 0;
+  solver->stamp += 0x9e3779b97f4a7c15ull;
+  int cells = 0;
+  int height = 1;
+  for (int x = 0; x < FIELD_WIDTH; x++) {
+    cells += board->filled[x];
+    if (FIELD_HEIGHT - board->heights[x] > height) {
+      height = FIELD_HEIGHT - board->heights[x];
+    }
+  }
+  PcSearch_t search = {.solver = solver,
+                       .current = current,
+                       .pieces = pieces,
+                       .plan = plan};
+  BotBoard_t root = *board;
+  root.lines = 0;
+  int found = 0;
+  for (int zone = height; !found && !search.stopped && zone <= FIELD_HEIGHT;
+       zone++) {
+    int empty = zone * FIELD_WIDTH - cells;
+    if (empty / 4 > count) break;
+    if (empty % 4) continue;
+    search.count = empty / 4;
+    search.zone = zone;
+    search.reach[search.count] = 0;
+    search.parity[search.count] = 0;
+    for (int i = search.count - 1; i >= 0; i--) {
+      int reach, parity;
+      pieceParity(pieces[i], &reach, &parity);
+      search.reach[i] = search.reach[i + 1] + reach;
+      search.parity[i] = parity < 0 || search.parity[i + 1] < 0
+                             ? -1
+                             : (search.parity[i + 1] + parity) & 1;
+    }
+    Row_t link = 0;
+    for (int y = FIELD_HEIGHT - zone; y < FIELD_HEIGHT; y++) {
+      link |= emptyPairs(root.rows[y]);
+    }
+    if (pcFeasible(&search, root.filled, link, zone, 0) &&
+        pcNode(&search, &root, 0)) {
+      found = search.count;
+    }
+  }
+  return search.stopped ? -1 : found;
+}
+
+/**
+ * @brief Ищет полную очистку для падающей фигуры игры: последовательность —
+ * текущая фигура, следующая и очередь.
+ *
+ * @param      solver     Решатель.
+ * @param      gc         Указатель на контекст игры.
+ * @param      max_pieces Наибольшее число фигур решения.
+ * @param[out] plan       Посадки решения.
+ * @return Число фигур решения; 0, если очистки нет или фигура не падает;
+ * -1, если поиск прерван по пределу узлов.
+ */
+int pcSolveGame(PcSolver_t *solver, const GameContext_t *gc, int max_pieces,
+                BotPlacement_t *plan) {
+  int8_t pieces[PC_MAX_PIECES];
+  int count = 2 + gc->queue.count;
+  if (count > max_pieces) count = max_pieces;
+  if (count > PC_MAX_PIECES) count = PC_MAX_PIECES;
+  pieces[0] = gc->current.piece;
+  pieces[1] = (int8_t)gc->next_piece;
+  for (int i = 2; i < count; i++) {
+    pieces[i] = (int8_t)queuePeek(&gc->queue, i - 2);
+  }
+  BotBoard_t board;
+  botBoardInit(&board, gc);
+  return gc->state == STATE_FALLING
+             ? pcSolve(solver, &board, &gc->current, pieces, count, plan)
+             : 0;
+}
@@ -0,0 +1,40 @@
+#ifndef PC_H
+#define PC_H
+#include <stdint.h>
+
+#include "bot.h"
+#include "rng.h"
+
+/** Наибольшее число фигур в решении: текущая, следующая и вся очередь. */
+#define PC_MAX_PIECES (2 + PIECE_QUEUE_SIZE)
+/** Таблица проигрышных узлов: 2^PC_TABLE_BITS ключей. */
+#define PC_TABLE_BITS 20
+
+/**
+ * Поиск полной очистки поля (perfect clear). Фигуры идут в известном
+ * порядке, поэтому узел перебора — поле и номер очередной фигуры. Ключи
+ * узлов, из которых очистки нет, хранятся в таблице table: одно и то же
+ * поле достигается разными порядками посадок, и повторно оно не
+ * раскрывается. Таблица не очищается: в ключ узла входит номер поиска
+ * stamp, и записи прошлых поисков с ключами нового не совпадают. nodes —
+ * число раскрытых узлов последнего поиска, max_nodes — их предел (0 — без
+ * предела), после которого поиск прерывается. boards — поля посадок на
+ * каждом уровне перебора.
+ */
+typedef struct PcSolver_t {
+  uint64_t *table;
+  BotBoard_t *boards;
+  uint64_t stamp;
+  long max_nodes;
+  long nodes;
+} PcSolver_t;
+
+PcSolver_t *pcCreate(long max_nodes);
+void pcDestroy(PcSolver_t *solver);
+int pcSolve(PcSolver_t *solver, const BotBoard_t *board,
+            const Tetromino_t *current, const int8_t *pieces, int count,
+            BotPlacement_t *plan);
+int pcSolveGame(PcSolver_t *solver, const GameContext_t *gc, int max_pieces,
+                BotPlacement_t *plan);
+
+#endif
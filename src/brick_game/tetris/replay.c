@@ -0,0 +1,444 @@
+#include "replay.h"
+
+#include <stdio.h>
+
+static const char replay_magic[4] = {'T', 'R', 'P', 'L'};
+
+/**
+ * @brief Гарантирует место под extra байт в буфере событий.
+ *
+ * @param r     Указатель на запись.
+ * @param extra Требуемое число свободных байт.
+ * @return 1 при успехе, 0 при нехватке памяти.
+ */
+static int reserveEvents(Replay_t *r, size_t extra) {
+  int ok = 1;
+  if (r->size + extra > r->capacity) {
+    size_t capacity = r->capacity ? r->capacity * 2 : 256;
+    while (capacity < r->size + extra) capacity *= 2;
+    uint8_t *events = realloc(r->events, capacity);
+    if (events) {
+      r->events = events;
+      r->capacity = capacity;
+    } else {
+      ok = 0;
+    }
+  }
+  return ok;
+}
+
+/**
+ * @brief Пишет число в формате varint (7 бит на байт, старший бит —
+ * продолжение).
+ *
+ * @param out   Буфер (не меньше 10 байт).
+ * @param value Значение.
+ * @return Число записанных байт.
+ */
+static size_t putVarint(uint8_t *out, uint64_t value) {
+  size_t n = 0;
+  while (value >= 0x80) {
+    out[n++] = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  out[n++] = (uint8_t)value;
+  return n;
+}
+
+/**
+ * @brief Читает varint из буфера.
+ *
+ * @param in    Буфер.
+ * @param size  Размер буфера.
+ * @param pos   Текущая позиция, сдвигается за прочитанное число.
+ * @param value Результат.
+ * @return 1 при успехе, 0 если буфер кончился.
+ */
+static int getVarint(const uint8_t *in, size_t size, size_t *pos,
+                     uint64_t *value) {
+  uint64_t result = 0;
+  int shift = 0;
+  int done = 0;
+  while (!done && *pos < size && shift < 64) {
+    uint8_t byte = in[(*pos)++];
+    result |= (uint64_t)(byte & 0x7f) << shift;
+    shift += 7;
+    done = !(byte & 0x80);
+  }
+  *value = result;
+  return done;
+}
+
+/**
+ * @brief Инициализирует пустую запись.
+ *
+ * @param r                 Указатель на запись.
+ * @param seed              Зерно генератора фигур.
+ * @param randomizer        Рандомайзер.
+ * @param keyframe_interval Ключевой кадр каждые N фигур (0 — без кадров).
+ */
+void replayInit(Replay_t *r, uint64_t seed, Randomizer_t randomizer,
+                uint32_t keyframe_interval) {
+  memset(r, 0, sizeof(*r));
+  r->seed = seed;
+  r->randomizer = randomizer;
+  r->das_ms = DEFAULT_DAS_MS;
+  r->arr_ms = DEFAULT_ARR_MS;
+  r->keyframe_interval = keyframe_interval;
+}
+
+/**
+ * @brief Освобождает буферы записи.
+ *
+ * @param r Указатель на запись.
+ */
+void replayFree(Replay_t *r) {
+  free(r->events);
+  free(r->keyframes);
+  memset(r, 0, sizeof(*r));
+}
+
+/**
+ * @brief Начинает новую игру на контексте и включает её запись.
+ *
+ * @param r                 Указатель на запись.
+ * @param gc                Указатель на контекст игры.
+ * @param seed              Зерно генератора фигур.
+ * @param randomizer        Рандомайзер.
+ * @param keyframe_interval Ключевой кадр каждые N фигур (0 — без кадров).
+ */
+void replayStart(Replay_t *r, GameContext_t *gc, uint64_t seed,
+                 Randomizer_t randomizer, uint32_t keyframe_interval) {
+  replayInit(r, seed, randomizer, keyframe_interval);
+  seedContext(gc, seed, randomizer);
+  r->das_ms = gc->shift.das_ms;
+  r->arr_ms = gc->shift.arr_ms;
+  r->start_time = r->last_time = gc->clock_ms;
+  gc->recorder = r;
+}
+
+/**
+ * @brief Останавливает запись и сохраняет итог игры для проверки.
+ *
+ * @param r  Указатель на запись.
+ * @param gc Указатель на контекст игры.
+ */
+void replayFinish(Replay_t *r, GameContext_t *gc) {
+  gc->recorder = NULL;
+  r->final_score = gc->info.score;
+  r->final_lines = gc->lines;
+}
+
+/**
+ * @brief Дописывает событие ввода в поток. Если буфер не удалось
+ * расширить, запись помечается потерянной (lost).
+ *
+ * @param r       Указатель на запись.
+ * @param time_ms Время события по часам контекста.
+ * @param action  Действие.
+ * @param hold    Флаг удержания.
+ */
+void replayAppend(Replay_t *r, uint32_t time_ms, UserAction_t action,
+                  bool hold) {
+  if (reserveEvents(r, 11)) {
+    uint32_t delta = time_ms - r->last_time;
+    uint8_t head = (uint8_t)((action & 7) | (hold ? 8 : 0));
+    r->last_time = time_ms;
+    if (delta < 15) {
+      r->events[r->size++] = (uint8_t)(head | delta << 4);
+    } else {
+      r->events[r->size++] = (uint8_t)(head | 15 << 4);
+      r->size += putVarint(r->events + r->size, delta - 15);
+    }
+    r->event_count++;
+  } else {
+    r->lost = true;
+  }
+}
+
+/**
+ * @brief Отмечает появление фигуры и через каждые keyframe_interval фигур
+ * сохраняет ключевой кадр.
+ *
+ * @param r  Указатель на запись.
+ * @param gc Указатель на записываемый контекст.
+ */
+void replayPieceSpawned(Replay_t *r, const GameContext_t *gc) {
+  r->pieces++;
+  if (r->keyframe_interval && r->pieces % r->keyframe_interval == 0) {
+    if (r->keyframe_count == r->keyframe_capacity) {
+      uint32_t capacity = r->keyframe_capacity ? r->keyframe_capacity * 2 : 8;
+      Keyframe_t *k = realloc(r->keyframes, capacity * sizeof(Keyframe_t));
+      if (k) {
+        r->keyframes = k;
+        r->keyframe_capacity = capacity;
+      }
+    }
+    if (r->keyframe_count < r->keyframe_capacity) {
+      Keyframe_t *k = &r->keyframes[r->keyframe_count++];
+      k->event_index = r->event_count;
+      k->offset = (uint32_t)r->size;
+      k->pieces = r->pieces;
+      saveSnapshot(gc, &k->snapshot);
+    }
+  }
+}
+
+static void writeVarint(FILE *f, uint64_t value) {
+  uint8_t buf[10];
+  fwrite(buf, 1, putVarint(buf, value), f);
+}
+
+/**
+ * @brief Сохраняет запись в файл: заголовок (магия, версия, ширина и высота
+ * поля, зерно, рандомайзер, DAS и ARR, интервал кадров, начальное время),
+ * поток событий, итог игры и ключевые кадры. Снимки пишутся в нативной
+ * раскладке ContextSnapshot_t, которая зависит от размера поля.
+ *
+ * @param r    Указатель на запись.
+ * @param path Путь к файлу.
+ * @return 1 при успехе, 0 при ошибке или если в записи потеряны события.
+ */
+int replaySave(const Replay_t *r, const char *path) {
+  FILE *f = r->lost ? NULL : fopen(path, "wb");
+  int ok = f != NULL;
+  if (ok) {
+    fwrite(replay_magic, 1, sizeof(replay_magic), f);
+    fputc(REPLAY_VERSION, f);
+    fputc(FIELD_WIDTH, f);
+    fputc(FIELD_HEIGHT, f);
+    writeVarint(f, r->seed);
+    fputc(r->randomizer, f);
+    writeVarint(f, r->das_ms);
+    writeVarint(f, r->arr_ms);
+    writeVarint(f, r->keyframe_interval);
+    writeVarint(f, r->start_time);
+    writeVarint(f, r->event_count);
+    writeVarint(f, r->size);
+    fwrite(r->events, 1, r->size, f);
+    writeVarint(f, r->pieces);
+    writeVarint(f, (uint64_t)r->final_score);
+    writeVarint(f, (uint64_t)r->final_lines);
+    writeVarint(f, r->keyframe_count);
+    for (uint32_t i = 0; i < r->keyframe_count; i++) {
+      const Keyframe_t *k = &r->keyframes[i];
+      writeVarint(f, k->event_index);
+      writeVarint(f, k->offset);
+      writeVarint(f, k->pieces);
+      fwrite(&k->snapshot, sizeof(k->snapshot), 1, f);
+    }
+    ok = !ferror(f);
+    ok = fclose(f) == 0 && ok;
+  }
+  return ok;
+}
+
+/**
+ * @brief Читает файл целиком в память.
+ *
+ * @param path Путь к файлу.
+ * @param size Размер прочитанного.
+ * @return Буфер (освобождает вызывающий) или NULL.
+ */
+static uint8_t *readFile(const char *path, size_t *size) {
+  uint8_t *data = NULL;
+  FILE *f = fopen(path, "rb");
+  if (f) {
+    size_t capacity = 4096;
+    *size = 0;
+    data = malloc(capacity);
+    size_t n;
+    while (data && (n = fread(data + *size, 1, capacity - *size, f)) > 0) {
+      *size += n;
+      if (*size == capacity) {
+        uint8_t *bigger = realloc(data, capacity * 2);
+        if (!bigger) free(data);
+        data = bigger;
+        capacity *= 2;
+      }
+    }
+    fclose(f);
+  }
+  return data;
+}
+
+/**
+ * @brief Проверяет снимок из файла перед тем, как отдать его
+ * loadSnapshot(): виды, повороты и положение фигур, состояние, очередь,
+ * направление автосдвига и цвета клеток должны быть в допустимых пределах,
+ * иначе они индексируют таблицы фигур и поле за их границами.
+ *
+ * @param s Снимок.
+ * @return 1, если снимок допустим.
+ */
+static int snapshotValid(const ContextSnapshot_t *s) {
+  int ok = s->current.piece >= 0 && s->current.piece < PIECE_COUNT &&
+           s->current.rotation >= 0 && s->current.rotation < ROTATION_COUNT &&
+           s->next_piece >= 0 && s->next_piece < PIECE_COUNT &&
+           s->state <= STATE_GAME_OVER && s->queue.mode <= RANDOMIZER_BAG &&
+           s->queue.head < PIECE_QUEUE_SIZE &&
+           s->queue.count <= PIECE_QUEUE_SIZE && s->shift.direction >= -1 &&
+           s->shift.direction <= 1;
+  ok = ok && figureInBounds(&s->current);
+  for (int i = 0; ok && i < PIECE_QUEUE_SIZE; i++) {
+    ok = s->queue.pieces[i] < PIECE_COUNT;
+  }
+  for (int y = 0; ok && y < FIELD_HEIGHT; y++) {
+    ok = !(s->rows[y] & (Row_t)~FULL_ROW);
+    for (int x = 0; ok && x < FIELD_WIDTH; x++) {
+      ok = s->colors[y][x] <= PIECE_COUNT;
+    }
+  }
+  return ok;
+}
+
+/**
+ * @brief Загружает запись из файла, созданного replaySave().
+ *
+ * @param r    Указатель на запись (инициализируется заново).
+ * @param path Путь к файлу.
+ * @return 1 при успехе, 0 если файл повреждён, другой версии, записан
+ * на поле другого размера или не хватило памяти.
+ */
+int replayLoad(Replay_t *r, const char *path) {
+  size_t size = 0, pos = sizeof(replay_magic) + 3;
+  uint8_t *data = readFile(path, &size);
+  uint64_t seed = 0, das = 0, arr = 0, interval = 0, start = 0, count = 0,
+           bytes = 0;
+  int ok = data && size > pos &&
+           !memcmp(data, replay_magic, sizeof(replay_magic)) &&
+           data[sizeof(replay_magic)] == REPLAY_VERSION &&
+           data[sizeof(replay_magic) + 1] == FIELD_WIDTH &&
+           data[sizeof(replay_magic) + 2] == FIELD_HEIGHT;
+  ok = ok && getVarint(data, size, &pos, &seed) && pos < size &&
+       data[pos] <= RANDOMIZER_BAG;
+  Randomizer_t randomizer = ok ? (Randomizer_t)data[pos++] : RANDOMIZER_UNIFORM;
+  ok = ok && getVarint(data, size, &pos, &das) &&
+       getVarint(data, size, &pos, &arr) &&
+       getVarint(data, size, &pos, &interval) &&
+       getVarint(data, size, &pos, &start) &&
+       getVarint(data, size, &pos, &count) &&
+       getVarint(data, size, &pos, &bytes) && bytes <= size - pos;
+  replayInit(r, seed, randomizer, (uint32_t)interval);
+  ok = ok && (!bytes || reserveEvents(r, bytes));
+  if (ok && bytes) memcpy(r->events, data + pos, bytes);
+  if (ok) {
+    r->das_ms = (uint16_t)das;
+    r->arr_ms = (uint16_t)arr;
+    r->start_time = (uint32_t)start;
+    r->size = bytes;
+    r->event_count = (uint32_t)count;
+    pos += bytes;
+  }
+  uint64_t pieces = 0, score = 0, lines = 0, keyframes = 0;
+  ok = ok && getVarint(data, size, &pos, &pieces) &&
+       getVarint(data, size, &pos, &score) &&
+       getVarint(data, size, &pos, &lines) &&
+       getVarint(data, size, &pos, &keyframes) &&
+       keyframes <= (size - pos) / sizeof(r->keyframes->snapshot);
+  if (ok) {
+    r->pieces = (uint32_t)pieces;
+    r->final_score = (int)score;
+    r->final_lines = (int)lines;
+    r->keyframes = keyframes ? malloc(keyframes * sizeof(Keyframe_t)) : NULL;
+    ok = !keyframes || r->keyframes;
+  }
+  for (uint64_t i = 0; ok && i < keyframes; i++) {
+    Keyframe_t *k = &r->keyframes[i];
+    uint64_t index = 0, offset = 0, kpieces = 0;
+    ok = getVarint(data, size, &pos, &index) &&
+         getVarint(data, size, &pos, &offset) &&
+         getVarint(data, size, &pos, &kpieces) &&
+         size - pos >= sizeof(k->snapshot) && offset <= r->size;
+    if (ok) {
+      k->event_index = (uint32_t)index;
+      k->offset = (uint32_t)offset;
+      k->pieces = (uint32_t)kpieces;
+      memcpy(&k->snapshot, data + pos, sizeof(k->snapshot));
+      pos += sizeof(k->snapshot);
+      ok = snapshotValid(&k->snapshot);
+    }
+    if (ok) {
+      r->keyframe_count = r->keyframe_capacity = (uint32_t)(i + 1);
+    }
+  }
+  free(data);
+  if (!ok) replayFree(r);
+  return ok;
+}
+
+/**
+ * @brief Проигрывает события потока на контексте без какой-либо задержки.
+ *
+ * @param r      Указатель на запись.
+ * @param gc     Указатель на контекст игры.
+ * @param offset Байтовая позиция первого события.
+ * @param index  Номер первого события.
+ * @param to     Номер события, перед которым остановиться.
+ * @return Число событий, применённых к контексту на момент остановки.
+ */
+static uint32_t playEvents(const Replay_t *r, GameContext_t *gc, size_t offset,
+                           uint32_t index, uint32_t to) {
+  uint32_t time = gc->clock_ms;
+  while (index < to && offset < r->size) {
+    uint8_t head = r->events[offset++];
+    uint64_t delta = head >> 4;
+    if (delta == 15) {
+      uint64_t rest = 0;
+      getVarint(r->events, r->size, &offset, &rest);
+      delta += rest;
+    }
+    time += (uint32_t)delta;
+    setContextClock(gc, time);
+    stepContext(gc, (UserAction_t)(head & 7), (head & 8) != 0);
+    index++;
+  }
+  return index;
+}
+
+/**
+ * @brief Приводит контекст к состоянию после event событий записи: загружает
+ * ближайший предшествующий ключевой кадр и доигрывает остаток.
+ *
+ * @param r     Указатель на запись.
+ * @param gc    Указатель на контекст игры (без включённой записи).
+ * @param event Номер события (UINT32_MAX — до конца записи).
+ * @return Число применённых событий.
+ */
+uint32_t replaySeek(const Replay_t *r, GameContext_t *gc, uint32_t event) {
+  const Keyframe_t *from = NULL;
+  for (uint32_t i = 0; i < r->keyframe_count; i++) {
+    if (r->keyframes[i].event_index <= event) from = &r->keyframes[i];
+  }
+  uint32_t played;
+  if (from) {
+    loadSnapshot(gc, &from->snapshot);
+    played = playEvents(r, gc, from->offset, from->event_index, event);
+  } else {
+    seedContext(gc, r->seed, r->randomizer);
+    setShiftTiming(gc, r->das_ms, r->arr_ms);
+    setContextClock(gc, r->start_time);
+    played = playEvents(r, gc, 0, 0, event);
+  }
+  return played;
+}
+
+/**
+ * @brief Переигрывает запись с нуля на отдельном контексте и сверяет итог.
+ *
+ * @param r Указатель на запись.
+ * @return 1, если счёт и число линий совпали с записанными; 0 — расхождение.
+ */
+int replayVerify(const Replay_t *r) {
+  GameContext_t *gc = createContext(NULL);
+  int ok = gc != NULL;
+  if (ok) {
+    seedContext(gc, r->seed, r->randomizer);
+    setShiftTiming(gc, r->das_ms, r->arr_ms);
+    setContextClock(gc, r->start_time);
+    playEvents(r, gc, 0, 0, r->event_count);
+    ok = gc->info.score == r->final_score && gc->lines == r->final_lines;
+    destroyContext(gc);
+  }
+  return ok;
+}
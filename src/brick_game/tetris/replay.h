@@ -0,0 +1,60 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+#include <stddef.h>
+#include <stdint.h>
+
+#include "backend.h"
+
+#define REPLAY_VERSION 3
+
+/**
+ * Ключевой кадр: снимок состояния после event_index событий; offset — позиция
+ * следующего события в потоке.
+ */
+typedef struct Keyframe_t {
+  uint32_t event_index;
+  uint32_t offset;
+  uint32_t pieces;
+  ContextSnapshot_t snapshot;
+} Keyframe_t;
+
+/**
+ * Запись игры: зерно, рандомайзер, тайминги автосдвига и поток событий.
+ * Событие кодируется байтом (биты 0–2 — действие, бит 3 — hold, биты 4–7 —
+ * приращение времени в мс; значение 15 означает, что остаток приращения
+ * следует varint'ом). lost — событие не поместилось в память, и запись
+ * больше не повторяет игру.
+ */
+typedef struct Replay_t {
+  uint64_t seed;
+  Randomizer_t randomizer;
+  uint16_t das_ms, arr_ms;
+  uint32_t keyframe_interval;
+  uint32_t start_time;
+  uint8_t *events;
+  size_t size, capacity;
+  uint32_t event_count;
+  uint32_t last_time;
+  uint32_t pieces;
+  Keyframe_t *keyframes;
+  uint32_t keyframe_count, keyframe_capacity;
+  int final_score;
+  int final_lines;
+  bool lost;
+} Replay_t;
+
+void replayInit(Replay_t *r, uint64_t seed, Randomizer_t randomizer,
+                uint32_t keyframe_interval);
+void replayFree(Replay_t *r);
+void replayStart(Replay_t *r, GameContext_t *gc, uint64_t seed,
+                 Randomizer_t randomizer, uint32_t keyframe_interval);
+void replayFinish(Replay_t *r, GameContext_t *gc);
+void replayAppend(Replay_t *r, uint32_t time_ms, UserAction_t action,
+                  bool hold);
+void replayPieceSpawned(Replay_t *r, const GameContext_t *gc);
+int replaySave(const Replay_t *r, const char *path);
+int replayLoad(Replay_t *r, const char *path);
+uint32_t replaySeek(const Replay_t *r, GameContext_t *gc, uint32_t event);
+int replayVerify(const Replay_t *r);
+
+#endif
@@ -0,0 +1,54 @@
+#include "ring.h"
+
+/**
+ * @brief Инициализирует пустую очередь.
+ *
+ * @param ring Указатель на очередь.
+ */
+void ringInit(ActionRing_t *ring) {
+  atomic_init(&ring->head, 0u);
+  atomic_init(&ring->tail, 0u);
+  ring->tail_cache = 0;
+  ring->head_cache = 0;
+}
+
+/**
+ * @brief Кладёт действие в очередь. Вызывается только писателем.
+ *
+ * @param ring  Указатель на очередь.
+ * @param event Действие.
+ * @return false, если очередь полна.
+ */
+bool ringPush(ActionRing_t *ring, const ActionEvent_t *event) {
+  unsigned tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  if (tail - ring->head_cache == ACTION_RING_SIZE) {
+    ring->head_cache = atomic_load_explicit(&ring->head, memory_order_acquire);
+  }
+  bool ok = tail - ring->head_cache < ACTION_RING_SIZE;
+  if (ok) {
+    ring->events[tail % ACTION_RING_SIZE] = *event;
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+  }
+  return ok;
+}
+
+/**
+ * @brief Забирает самое старое действие из очереди. Вызывается только
+ * читателем.
+ *
+ * @param ring  Указатель на очередь.
+ * @param event Куда записать действие.
+ * @return false, если очередь пуста.
+ */
+bool ringPop(ActionRing_t *ring, ActionEvent_t *event) {
+  unsigned head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  if (head == ring->tail_cache) {
+    ring->tail_cache = atomic_load_explicit(&ring->tail, memory_order_acquire);
+  }
+  bool ok = head != ring->tail_cache;
+  if (ok) {
+    *event = ring->events[head % ACTION_RING_SIZE];
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+  }
+  return ok;
+}
@@ -0,0 +1,38 @@
+#ifndef RING_H
+#define RING_H
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "game.h"
+
+#define ACTION_RING_SIZE 256
+#define RING_ALIGN 64
+
+/** Действие игрока с флагом удержания и моментом нажатия (мкс). */
+typedef struct ActionEvent_t {
+  UserAction_t action;
+  bool hold;
+  int64_t time_us;
+} ActionEvent_t;
+
+/**
+ * Кольцевая очередь действий для одного писателя и одного читателя без
+ * блокировок. head двигает только читатель, tail — только писатель; каждая
+ * сторона держит копию чужого индекса и перечитывает его, лишь когда копия
+ * говорит, что очередь пуста или полна. Индексы растут неограниченно, ячейка
+ * берётся по модулю ACTION_RING_SIZE (степень двойки).
+ */
+typedef struct ActionRing_t {
+  _Alignas(RING_ALIGN) atomic_uint head;
+  unsigned tail_cache;
+  _Alignas(RING_ALIGN) atomic_uint tail;
+  unsigned head_cache;
+  _Alignas(RING_ALIGN) ActionEvent_t events[ACTION_RING_SIZE];
+} ActionRing_t;
+
+void ringInit(ActionRing_t *ring);
+bool ringPush(ActionRing_t *ring, const ActionEvent_t *event);
+bool ringPop(ActionRing_t *ring, ActionEvent_t *event);
+
+#endif
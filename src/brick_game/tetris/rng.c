@@ -0,0 +1,141 @@
+#include "rng.h"
+
+/**
+ * @brief Один шаг splitmix64, используется для разворачивания зерна.
+ *
+ * @param x Указатель на состояние splitmix64.
+ * @return Очередное 64-битное значение.
+ */
+static uint64_t splitMix64(uint64_t *x) {
+  uint64_t z = (*x += 0x9e3779b97f4a7c15ull);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+  return z ^ (z >> 31);
+}
+
+static inline uint64_t rotl(uint64_t x, int k) {
+  return (x << k) | (x >> (64 - k));
+}
+
+/**
+ * @brief Инициализирует генератор из 64-битного зерна. Одинаковое зерно даёт
+ * одинаковую последовательность на любой платформе и в любом потоке.
+ *
+ * @param rng  Указатель на генератор.
+ * @param seed Зерно.
+ */
+void rngSeed(Rng_t *rng, uint64_t seed) {
+  for (int i = 0; i < 4; i++) {
+    rng->s[i] = splitMix64(&seed);
+  }
+}
+
+/**
+ * @brief Возвращает следующее число xoshiro256**.
+ *
+ * @param rng Указатель на генератор.
+ * @return Псевдослучайное 64-битное число.
+ */
+uint64_t rngNext(Rng_t *rng) {
+  uint64_t *s = rng->s;
+  uint64_t result = rotl(s[1] * 5, 7) * 9;
+  uint64_t t = s[1] << 17;
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = rotl(s[3], 45);
+  return result;
+}
+
+/**
+ * @brief Возвращает равномерно распределённое число из [0, bound) методом
+ * умножения Лемира (без деления в обычном случае).
+ *
+ * @param rng   Указатель на генератор.
+ * @param bound Верхняя граница (> 0).
+ * @return Число из [0, bound).
+ */
+uint32_t rngBounded(Rng_t *rng, uint32_t bound) {
+  uint64_t m = (rngNext(rng) >> 32) * bound;
+  uint32_t low = (uint32_t)m;
+  if (low < bound) {
+    uint32_t threshold = (uint32_t)(-bound) % bound;
+    while (low < threshold) {
+      m = (rngNext(rng) >> 32) * bound;
+      low = (uint32_t)m;
+    }
+  }
+  return (uint32_t)(m >> 32);
+}
+
+/**
+ * @brief Дописывает в хвост очереди BAG_SIZE фигур.
+ *
+ * @param q Указатель на очередь.
+ */
+static void queueRefill(PieceQueue_t *q) {
+  uint8_t batch[BAG_SIZE];
+  if (q->mode == RANDOMIZER_BAG) {
+    for (int i = 0; i < BAG_SIZE; i++) {
+      batch[i] = (uint8_t)i;
+    }
+    for (int i = BAG_SIZE - 1; i > 0; i--) {
+      int j = (int)rngBounded(&q->rng, (uint32_t)i + 1);
+      uint8_t tmp = batch[i];
+      batch[i] = batch[j];
+      batch[j] = tmp;
+    }
+  } else {
+    for (int i = 0; i < BAG_SIZE; i++) {
+      batch[i] = (uint8_t)rngBounded(&q->rng, BAG_SIZE);
+    }
+  }
+  for (int i = 0; i < BAG_SIZE; i++) {
+    q->pieces[(q->head + q->count + i) % PIECE_QUEUE_SIZE] = batch[i];
+  }
+  q->count += BAG_SIZE;
+}
+
+/**
+ * @brief Инициализирует очередь фигур с заданным зерном и рандомайзером.
+ *
+ * @param q    Указатель на очередь.
+ * @param seed Зерно генератора.
+ * @param mode RANDOMIZER_UNIFORM — независимые броски, RANDOMIZER_BAG — 7-bag.
+ */
+void queueInit(PieceQueue_t *q, uint64_t seed, Randomizer_t mode) {
+  rngSeed(&q->rng, seed);
+  q->mode = mode;
+  q->head = 0;
+  q->count = 0;
+  queueRefill(q);
+}
+
+/**
+ * @brief Извлекает очередную фигуру из очереди.
+ *
+ * @param q Указатель на очередь.
+ * @return Индекс фигуры 0..BAG_SIZE-1.
+ */
+int queuePop(PieceQueue_t *q) {
+  int piece = q->pieces[q->head];
+  q->head = (uint8_t)((q->head + 1) % PIECE_QUEUE_SIZE);
+  q->count--;
+  if (q->count < BAG_SIZE) {
+    queueRefill(q);
+  }
+  return piece;
+}
+
+/**
+ * @brief Возвращает фигуру из очереди, не извлекая её.
+ *
+ * @param q     Указатель на очередь.
+ * @param index Смещение от головы, 0 <= index < BAG_SIZE.
+ * @return Индекс фигуры.
+ */
+int queuePeek(const PieceQueue_t *q, int index) {
+  return q->pieces[(q->head + index) % PIECE_QUEUE_SIZE];
+}
@@ -0,0 +1,36 @@
+#ifndef RNG_H
+#define RNG_H
+#include <stdint.h>
+
+#define BAG_SIZE 7
+#define PIECE_QUEUE_SIZE 16
+
+/** Состояние генератора xoshiro256**. */
+typedef struct Rng_t {
+  uint64_t s[4];
+} Rng_t;
+
+typedef enum Randomizer_t { RANDOMIZER_UNIFORM, RANDOMIZER_BAG } Randomizer_t;
+
+/**
+ * Очередь предстоящих фигур. Пополняется пачками по BAG_SIZE фигур (целый
+ * перемешанный мешок или BAG_SIZE независимых бросков), так что после любого
+ * queuePop() в ней остаётся не меньше BAG_SIZE фигур для просмотра вперёд.
+ */
+typedef struct PieceQueue_t {
+  Rng_t rng;
+  Randomizer_t mode;
+  uint8_t pieces[PIECE_QUEUE_SIZE];
+  uint8_t head;
+  uint8_t count;
+} PieceQueue_t;
+
+void rngSeed(Rng_t *rng, uint64_t seed);
+uint64_t rngNext(Rng_t *rng);
+uint32_t rngBounded(Rng_t *rng, uint32_t bound);
+
+void queueInit(PieceQueue_t *q, uint64_t seed, Randomizer_t mode);
+int queuePop(PieceQueue_t *q);
+int queuePeek(const PieceQueue_t *q, int index);
+
+#endif
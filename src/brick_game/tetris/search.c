@@ -0,0 +1,446 @@
+#define _POSIX_C_SOURCE 200809L
+#include "search.h"
+
+#include <stdlib.h>
+#include <time.h>
+
+#include "batch.h"
+
+/**
+ * Состояние воркера на один проход: счётчики узлов, попаданий в таблицу и
+ * проверок часов.
+ */
+typedef struct SearchWorker_t {
+  SearchPool_t *pool;
+  long nodes;
+  long hits;
+  int clock;
+} SearchWorker_t;
+
+/**
+ * @brief Возвращает показания монотонных часов в микросекундах.
+ *
+ * @return Время в микросекундах от произвольной точки отсчёта.
+ */
+static int64_t searchClockUs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * @brief Проверяет, не истёк ли срок прохода. Часы опрашиваются раз в
+ * SEARCH_CLOCK_NODES узлов; истечение видят все воркеры.
+ *
+ * @param w     Воркер.
+ * @param nodes Сколько узлов раскроется, если срок не истёк.
+ * @return true, если проход нужно прервать.
+ */
+static bool searchExpired(SearchWorker_t *w, int nodes) {
+  SearchPool_t *pool = w->pool;
+  if (pool->deadline_us && (w->clock += nodes) >= SEARCH_CLOCK_NODES) {
+    w->clock = 0;
+    if (searchClockUs() >= pool->deadline_us) {
+      atomic_store_explicit(&pool->expired, true, memory_order_relaxed);
+    }
+  }
+  return atomic_load_explicit(&pool->expired, memory_order_relaxed);
+}
+
+/**
+ * @brief Ищет оценку узла в таблице транспозиций.
+ *
+ * @param      pool  Пул.
+ * @param      key   Ключ узла.
+ * @param      depth Оставшаяся глубина узла.
+ * @param[out] value Оценка при попадании, без вклада линий, очищенных до
+ *                   узла.
+ * @return true, если в таблице есть оценка этого узла на этой глубине.
+ */
+static bool searchProbe(SearchPool_t *pool, uint64_t key, int depth,
+                        float *value) {
+  SearchEntry_t *e = &pool->table[key & ((1u << SEARCH_TABLE_BITS) - 1)];
+  uint64_t data = atomic_load_explicit(&e->data, memory_order_relaxed);
+  uint64_t check = atomic_load_explicit(&e->check, memory_order_relaxed);
+  bool hit = (check ^ data) == key && (int)(data >> 32 & 0xff) == depth;
+  if (hit) {
+    uint32_t bits = (uint32_t)data;
+    memcpy(value, &bits, sizeof(*value));
+  }
+  return hit;
+}
+
+/**
+ * @brief Записывает оценку узла в таблицу транспозиций, если запись на её
+ * месте не глубже или осталась от прошлого перебора.
+ *
+ * @param pool  Пул.
+ * @param key   Ключ узла.
+ * @param depth Оставшаяся глубина узла.
+ * @param value Оценка без вклада линий, очищенных до узла.
+ */
+static void searchStore(SearchPool_t *pool, uint64_t key, int depth,
+                        float value) {
+  SearchEntry_t *e = &pool->table[key & ((1u << SEARCH_TABLE_BITS) - 1)];
+  uint64_t old = atomic_load_explicit(&e->data, memory_order_relaxed);
+  if ((uint8_t)(old >> 40) != pool->age || (int)(old >> 32 & 0xff) <= depth) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint64_t data = bits | (uint64_t)depth << 32 | (uint64_t)pool->age << 40;
+    atomic_store_explicit(&e->data, data, memory_order_relaxed);
+    atomic_store_explicit(&e->check, key ^ data, memory_order_relaxed);
+  }
+}
+
+/**
+ * @brief Оценивает поле лучшей из посадок оставшихся фигур прохода.
+ *
+ * @param w     Воркер.
+ * @param board Поле после ply посадок.
+ * @param ply   Число уже посаженных фигур.
+ * @return Оценка лучшего листа поддерева; если очередной фигуре некуда
+ * появиться — оценка поля минус SEARCH_TOP_OUT.
+ */
+static float searchNode(SearchWorker_t *w, const BotBoard_t *board, int ply) {
+  SearchPool_t *pool = w->pool;
+  if (ply == pool->depth) return botEvaluate(board, pool->weights);
+  uint64_t key = board->hash ^ pool->sequence[ply];
+  /* board->lines отсчитаны от корня хода, а запись переживает ход. */
+  float cleared = pool->weights->lines * board->lines;
+  float best;
+  if (searchProbe(pool, key, pool->depth - ply, &best)) {
+    w->hits++;
+    return best + cleared;
+  }
+  BotPlacement_t moves[BOT_MAX_PLACEMENTS];
+  Tetromino_t spawn = {pool->pieces[ply], 0, SPAWN_X, SPAWN_Y};
+  int n = botPlacements(board, &spawn, moves);
+  best = botEvaluate(board, pool->weights) - SEARCH_TOP_OUT;
+  if (ply + 1 < pool->depth) {
+    for (int i = 0; i < n && !searchExpired(w, 1); i++) {
+      BotBoard_t child = *board;
+      botPlace(&child, &moves[i].piece);
+      float value = searchNode(w, &child, ply + 1);
+      if (i == 0 || value > best) best = value;
+    }
+  } else if (n > 0 && !searchExpired(w, n)) {
+    best = batchBest(board, moves, n, pool->weights);
+  }
+  w->nodes += n;
+  if (!atomic_load_explicit(&pool->expired, memory_order_relaxed)) {
+    searchStore(pool, key, pool->depth - ply, best - cleared);
+  }
+  return best;
+}
+
+/**
+ * @brief Выполняет задачи прохода: сначала из своей очереди, затем из
+ * чужих по кругу, пока задачи не кончатся или не истечёт срок.
+ *
+ * @param pool Пул.
+ * @param id   Номер воркера.
+ */
+static void searchWork(SearchPool_t *pool, int id) {
+  SearchWorker_t w = {pool, 0, 0, 0};
+  for (int k = 0; k < pool->workers; k++) {
+    SearchDeque_t *deque = &pool->deques[(id + k) % pool->workers];
+    int i;
+    while (!searchExpired(&w, 1) &&
+           (i = atomic_fetch_add_explicit(&deque->next, 1,
+                                          memory_order_relaxed)) <
+               deque->end) {
+      const SearchTask_t *task = &pool->tasks[i];
+      BotBoard_t board = pool->after[task->first];
+      botPlace(&board, &task->second);
+      pool->values[i] = searchNode(&w, &board, 2);
+    }
+  }
+  atomic_fetch_add_explicit(&pool->nodes, w.nodes, memory_order_relaxed);
+  atomic_fetch_add_explicit(&pool->hits, w.hits, memory_order_relaxed);
+}
+
+/**
+ * @brief Поток пула: ждёт очередной проход, получает номер воркера и
+ * участвует в нём.
+ *
+ * @param arg Пул (SearchPool_t).
+ * @return NULL.
+ */
+static void *searchThread(void *arg) {
+  SearchPool_t *pool = arg;
+  unsigned seen = 0;
+  pthread_mutex_lock(&pool->lock);
+  while (true) {
+    while (pool->generation == seen && !pool->quit) {
+      pthread_cond_wait(&pool->start, &pool->lock);
+    }
+    if (pool->quit) break;
+    seen = pool->generation;
+    int id = pool->workers - pool->running;
+    pool->running--;
+    pthread_mutex_unlock(&pool->lock);
+    searchWork(pool, id);
+    pthread_mutex_lock(&pool->lock);
+    if (--pool->active == 0) pthread_cond_signal(&pool->done);
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return NULL;
+}
+
+/**
+ * @brief Делит задачи между очередями воркеров поровну, запускает проход и
+ * ждёт, пока его закончат все воркеры.
+ *
+ * @param pool Пул.
+ */
+static void searchPass(SearchPool_t *pool) {
+  int start = 0;
+  for (int i = 0; i < pool->workers; i++) {
+    int size = pool->task_count / pool->workers +
+               (i < pool->task_count % pool->workers);
+    atomic_store_explicit(&pool->deques[i].next, start, memory_order_relaxed);
+    pool->deques[i].end = start + size;
+    start += size;
+  }
+  pthread_mutex_lock(&pool->lock);
+  pool->running = pool->workers - 1;
+  pool->active = pool->workers - 1;
+  pool->generation++;
+  pthread_cond_broadcast(&pool->start);
+  pthread_mutex_unlock(&pool->lock);
+  searchWork(pool, 0);
+  pthread_mutex_lock(&pool->lock);
+  while (pool->active) pthread_cond_wait(&pool->done, &pool->lock);
+  pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * @brief Останавливает и дожидается первых count потоков пула.
+ *
+ * @param pool  Пул.
+ * @param count Число запущенных потоков.
+ */
+static void searchStop(SearchPool_t *pool, int count) {
+  pthread_mutex_lock(&pool->lock);
+  pool->quit = true;
+  pthread_cond_broadcast(&pool->start);
+  pthread_mutex_unlock(&pool->lock);
+  for (int i = 0; i < count; i++) pthread_join(pool->threads[i], NULL);
+}
+
+/**
+ * @brief Создаёт пул перебора и запускает его потоки.
+ *
+ * @param workers Число воркеров вместе с вызывающим потоком (1 —
+ * однопоточный перебор), не больше SEARCH_MAX_WORKERS.
+ * @return Пул или NULL, если не хватило памяти или потоков.
+ */
+SearchPool_t *searchCreate(int workers) {
+  if (workers < 1) workers = 1;
+  if (workers > SEARCH_MAX_WORKERS) workers = SEARCH_MAX_WORKERS;
+  SearchPool_t *pool = aligned_alloc(SEARCH_ALIGN, sizeof(SearchPool_t));
+  if (!pool) return NULL;
+  memset(pool, 0, sizeof(*pool));
+  pool->workers = workers;
+  pool->first = malloc(BOT_MAX_PLACEMENTS * sizeof(BotPlacement_t));
+  pool->after = malloc(BOT_MAX_PLACEMENTS * sizeof(BotBoard_t));
+  pool->table = calloc((size_t)1 << SEARCH_TABLE_BITS, sizeof(SearchEntry_t));
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->start, NULL);
+  pthread_cond_init(&pool->done, NULL);
+  bool ok = pool->first && pool->after && pool->table;
+  int started = 0;
+  while (ok && started < workers - 1) {
+    ok = pthread_create(&pool->threads[started], NULL, searchThread, pool) ==
+         0;
+    started += ok;
+  }
+  if (!ok) {
+    searchStop(pool, started);
+    pool->workers = 0;
+    searchDestroy(pool);
+    pool = NULL;
+  }
+  return pool;
+}
+
+/**
+ * @brief Останавливает потоки пула и освобождает его.
+ *
+ * @param pool Пул (NULL допускается).
+ */
+void searchDestroy(SearchPool_t *pool) {
+  if (pool) {
+    if (pool->workers) searchStop(pool, pool->workers - 1);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->start);
+    pthread_cond_destroy(&pool->done);
+    free(pool->first);
+    free(pool->after);
+    free(pool->tasks);
+    free(pool->values);
+    free(pool->table);
+    free(pool);
+  }
+}
+
+/**
+ * @brief Увеличивает список задач, чтобы в нём поместилось ещё count задач.
+ * Посадок с подсовами бывает намного больше, чем по столбцу на поворот,
+ * поэтому список растёт по мере надобности, а не заводится под худший
+ * случай.
+ *
+ * @param pool  Пул.
+ * @param count Число добавляемых задач.
+ * @return true, если места хватает.
+ */
+static bool searchReserve(SearchPool_t *pool, int count) {
+  bool ok = true;
+  if (pool->task_count + count > pool->task_capacity) {
+    int capacity = pool->task_capacity ? pool->task_capacity : 1024;
+    while (capacity < pool->task_count + count) capacity *= 2;
+    SearchTask_t *tasks =
+        realloc(pool->tasks, (size_t)capacity * sizeof(SearchTask_t));
+    if (tasks) pool->tasks = tasks;
+    float *values =
+        tasks ? realloc(pool->values, (size_t)capacity * sizeof(float)) : NULL;
+    if (values) pool->values = values;
+    ok = tasks && values;
+    if (ok) pool->task_capacity = capacity;
+  }
+  return ok;
+}
+
+/**
+ * @brief Раскрывает корень: посадки текущей фигуры, поля после них и
+ * задачи — пары с посадками следующей фигуры.
+ *
+ * @param pool Пул.
+ * @param gc   Указатель на контекст игры. Если под задачи не хватило
+ * памяти, корень остаётся пустым.
+ */
+static void searchExpand(SearchPool_t *pool, const GameContext_t *gc) {
+  BotBoard_t root;
+  botBoardInit(&root, gc);
+  pool->first_count = gc->state == STATE_FALLING
+                          ? botPlacements(&root, &gc->current, pool->first)
+                          : 0;
+  Tetromino_t spawn = {pool->pieces[1], 0, SPAWN_X, SPAWN_Y};
+  BotPlacement_t moves[BOT_MAX_PLACEMENTS];
+  bool ok = true;
+  pool->task_count = 0;
+  for (int i = 0; ok && i < pool->first_count; i++) {
+    pool->after[i] = root;
+    botPlace(&pool->after[i], &pool->first[i].piece);
+    int n = botPlacements(&pool->after[i], &spawn, moves);
+    ok = searchReserve(pool, n);
+    for (int j = 0; ok && j < n; j++) {
+      SearchTask_t *task = &pool->tasks[pool->task_count++];
+      task->first = i;
+      task->second = moves[j].piece;
+    }
+  }
+  if (!ok) {
+    pool->first_count = 0;
+    pool->task_count = 0;
+  }
+}
+
+/**
+ * @brief Готовит ключи последовательностей фигур прохода: sequence[ply] —
+ * хеш фигур pieces[ply..depth - 1] по порядку.
+ *
+ * @param pool Пул с заданными depth и pieces.
+ */
+static void searchSequence(SearchPool_t *pool) {
+  uint64_t key = 0;
+  for (int ply = pool->depth - 1; ply >= 0; ply--) {
+    key = hashMix(key ^ (uint64_t)(pool->pieces[ply] + 1));
+    pool->sequence[ply] = key;
+  }
+}
+
+/**
+ * @brief Сводит значения задач завершённого прохода к лучшей посадке
+ * текущей фигуры. Задачи одной посадки идут в списке подряд.
+ *
+ * @param pool Пул.
+ * @return Индекс лучшей посадки в pool->first.
+ */
+static int searchReduce(const SearchPool_t *pool) {
+  int best = 0;
+  float best_value = 0;
+  int t = 0;
+  for (int i = 0; i < pool->first_count; i++) {
+    float value = botEvaluate(&pool->after[i], pool->weights) - SEARCH_TOP_OUT;
+    for (int j = 0; t < pool->task_count && pool->tasks[t].first == i;
+         j++, t++) {
+      if (j == 0 || pool->values[t] > value) value = pool->values[t];
+    }
+    if (i == 0 || value > best_value) {
+      best_value = value;
+      best = i;
+    }
+  }
+  return best;
+}
+
+/**
+ * @brief Выбирает посадку падающей фигуры перебором на depth фигур вперёд:
+ * текущая, следующая и depth - 2 фигуры из очереди. На глубине 2 выбор
+ * совпадает с botChoose().
+ *
+ * Перебор углубляется от 2 до depth. Проход на глубину 2 выполняется
+ * всегда, более глубокие — пока не истёк срок budget_us; прерванный проход
+ * отбрасывается.
+ *
+ * @param      pool      Пул.
+ * @param      gc        Указатель на контекст игры (STATE_FALLING).
+ * @param      weights   Веса оценки.
+ * @param      depth     Число фигур в переборе, от 2 до SEARCH_MAX_DEPTH.
+ * @param      budget_us Срок на ход в микросекундах, 0 — без срока.
+ * @param[out] best      Лучшая посадка.
+ * @param[out] stats     Глубина и число узлов (NULL допускается).
+ * @return 1, если посадка найдена; 0 — фигура не падает или ей некуда идти.
+ */
+int searchChoose(SearchPool_t *pool, const GameContext_t *gc,
+                 const BotWeights_t *weights, int depth, long budget_us,
+                 BotPlacement_t *best, SearchStats_t *stats) {
+  int64_t deadline = budget_us > 0 ? searchClockUs() + budget_us : 0;
+  if (depth < 2) depth = 2;
+  if (depth > SEARCH_MAX_DEPTH) depth = SEARCH_MAX_DEPTH;
+  pool->pieces[0] = gc->current.piece;
+  pool->pieces[1] = (int8_t)gc->next_piece;
+  for (int i = 2; i < depth; i++) {
+    pool->pieces[i] = (int8_t)queuePeek(&gc->queue, i - 2);
+  }
+  if (memcmp(&pool->table_weights, weights, sizeof(*weights))) {
+    memset(pool->table, 0,
+           ((size_t)1 << SEARCH_TABLE_BITS) * sizeof(SearchEntry_t));
+    pool->table_weights = *weights;
+  }
+  pool->weights = weights;
+  pool->age++;
+  searchExpand(pool, gc);
+  atomic_store_explicit(&pool->nodes, pool->first_count + pool->task_count,
+                        memory_order_relaxed);
+  atomic_store_explicit(&pool->hits, 0, memory_order_relaxed);
+  atomic_store_explicit(&pool->expired, false, memory_order_relaxed);
+  int done = 0;
+  for (int d = 2; pool->first_count && d <= depth; d++) {
+    pool->depth = d;
+    pool->deadline_us = d > 2 ? deadline : 0;
+    searchSequence(pool);
+    searchPass(pool);
+    if (atomic_load_explicit(&pool->expired, memory_order_relaxed)) break;
+    *best = pool->first[searchReduce(pool)];
+    done = d;
+    if (deadline && searchClockUs() >= deadline) break;
+  }
+  if (stats) {
+    stats->depth = done;
+    stats->nodes = atomic_load_explicit(&pool->nodes, memory_order_relaxed);
+    stats->hits = atomic_load_explicit(&pool->hits, memory_order_relaxed);
+  }
+  return pool->first_count > 0;
+}
@@ -0,0 +1,122 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "bot.h"
+#include "rng.h"
+
+#define SEARCH_ALIGN 64
+#define SEARCH_MAX_WORKERS 64
+/** Глубина перебора: текущая фигура, следующая и видимая часть очереди. */
+#define SEARCH_MAX_DEPTH (2 + BAG_SIZE)
+/** Узлов между проверками часов. */
+#define SEARCH_CLOCK_NODES 256
+/** Штраф листа, после которого очередной фигуре некуда появиться. */
+#define SEARCH_TOP_OUT 1e6f
+/** Таблица транспозиций: 2^SEARCH_TABLE_BITS записей по 16 байт. */
+#define SEARCH_TABLE_BITS 18
+
+/**
+ * Запись таблицы транспозиций без блокировок. data — оценка узла (биты
+ * float), оставшаяся глубина и поколение перебора; check — ключ узла XOR
+ * data. Слова пишутся и читаются независимо, поэтому запись, разорванная
+ * гонкой двух писателей, не проходит проверку ключа и считается промахом.
+ */
+typedef struct SearchEntry_t {
+  atomic_uint_least64_t check;
+  atomic_uint_least64_t data;
+} SearchEntry_t;
+
+/**
+ * Задача перебора: поддерево под парой посадок текущей (first — индекс в
+ * SearchPool_t.first) и следующей фигуры.
+ */
+typedef struct SearchTask_t {
+  int first;
+  Tetromino_t second;
+} SearchTask_t;
+
+/**
+ * Очередь задач воркера — отрезок [next, end) общего списка задач. Набор
+ * задач прохода известен заранее, поэтому очередь не растёт: и владелец,
+ * и воры забирают задачи атомарным сдвигом next.
+ */
+typedef struct SearchDeque_t {
+  _Alignas(SEARCH_ALIGN) atomic_int next;
+  int end;
+} SearchDeque_t;
+
+/**
+ * Итог перебора: глубина последнего завершённого прохода, число раскрытых
+ * узлов и попаданий в таблицу транспозиций.
+ */
+typedef struct SearchStats_t {
+  int depth;
+  long nodes;
+  long hits;
+} SearchStats_t;
+
+/**
+ * Пул потоков перебора с кражей работы. Корень (посадки текущей фигуры и
+ * следующей) раскрывает вызывающий поток, поддеревья делятся между
+ * воркерами поровну, а освободившийся воркер забирает задачи из чужих
+ * очередей. Каждый воркер перебирает на своих копиях поля BotBoard_t.
+ * Перебор идёт с углублением: проход на глубину d начинается, только если
+ * завершился проход d - 1, и по истечении срока прерывается, оставляя
+ * результат предыдущего. Пул переиспользуется от хода к ходу; вызывающий
+ * поток — воркер 0. running — сколько потоков ещё не взяли номер в текущем
+ * проходе, active — сколько ещё не закончили его.
+ *
+ * Одно и то же поле с теми же оставшимися фигурами достигается разными
+ * порядками посадок, поэтому оценки узлов с оставшейся глубиной от 1
+ * кешируются в общей таблице транспозиций table. Ключ узла — хеш поля XOR
+ * sequence[ply], хеш оставшихся фигур. Оценка хранится без вклада линий,
+ * очищенных от корня хода до узла, и он прибавляется при попадании; так
+ * записи остаются верными и в следующих ходах. Запись вытесняется записью
+ * не меньшей глубины или записью нового поколения age. Смена весов
+ * очищает таблицу.
+ */
+typedef struct SearchPool_t {
+  int workers;
+  pthread_t threads[SEARCH_MAX_WORKERS];
+  pthread_mutex_t lock;
+  pthread_cond_t start;
+  pthread_cond_t done;
+  unsigned generation;
+  int running;
+  int active;
+  bool quit;
+
+  const BotWeights_t *weights;
+  int depth;
+  int8_t pieces[SEARCH_MAX_DEPTH];
+  uint64_t sequence[SEARCH_MAX_DEPTH];
+  int64_t deadline_us;
+  atomic_bool expired;
+  atomic_long nodes;
+  atomic_long hits;
+
+  SearchEntry_t *table;
+  BotWeights_t table_weights;
+  uint8_t age;
+
+  BotPlacement_t *first;
+  BotBoard_t *after;
+  int first_count;
+  SearchTask_t *tasks;
+  float *values;
+  int task_count;
+  int task_capacity;
+  SearchDeque_t deques[SEARCH_MAX_WORKERS];
+} SearchPool_t;
+
+SearchPool_t *searchCreate(int workers);
+void searchDestroy(SearchPool_t *pool);
+int searchChoose(SearchPool_t *pool, const GameContext_t *gc,
+                 const BotWeights_t *weights, int depth, long budget_us,
+                 BotPlacement_t *best, SearchStats_t *stats);
+
+#endif
@@ -1,19 +1,27 @@
+#define _POSIX_C_SOURCE 200809L
 #include "frontend.h"
+
 /**
  * @brief Инициализирует режим ncurses.
  *
  * Устанавливает локаль, запускает ncurses, отключает отображение вводимых
  * символов, скрывает курсор, включает поддержку функциональных клавиш и делает
- * ввод неблокирующим.
+ * ввод неблокирующим. Одиночный ESC отличается от escape-последовательности
+ * стрелок по тайм-ауту ESC_DELAY_MS вместо стандартной секунды ncurses;
+ * переменная окружения ESCDELAY его переопределяет. Очистка экрана
+ * выводится сразу: иначе её выполнит первый getch(), стерев окна, которые
+ * дальше перерисовываются только по изменениям.
  */
 void initNcurses() {
   setlocale(LC_ALL, "");
   initscr();
   clear();
+  refresh();
   noecho();
   curs_set(0);
   keypad(stdscr, TRUE);
   nodelay(stdscr, TRUE);
+  if (!getenv("ESCDELAY")) set_escdelay(ESC_DELAY_MS);
 }
 
 /**
@@ -53,71 +61,141 @@ void initColors() {
 
 /**
  * @brief Создаёт и настраивает два окна: игровое поле и боковую панель.
+ * Окно поля повторяет размер поля сборки, боковая панель встаёт справа от
+ * него и не бывает ниже своего содержимого.
  *
  * @param[out] fwin Указатель на переменную, куда сохраняется окно игрового
  * поля.
  * @param[out] swin Указатель на переменную, куда сохраняется окно боковой
  * панели.
+ * @return false, если окна не помещаются в терминал.
  */
-void createWindows(WINDOW **fwin, WINDOW **swin) {
-  *fwin = newwin(FIELD_HEIGHT + 2, FIELD_WIDTH * 2 + 2, 0, 0);
-  wbkgd(*fwin, COLOR_PAIR(8));
-  wattron(*fwin, COLOR_WHITE);
-  box(*fwin, 0, 0);
-  wattroff(*fwin, COLOR_WHITE);
-  wrefresh(*fwin);
+bool createWindows(WINDOW **fwin, WINDOW **swin) {
+  int side_height = FIELD_WIN_HEIGHT > SIDE_HEIGHT ? FIELD_WIN_HEIGHT
+                                                   : SIDE_HEIGHT;
+  bool fits = LINES >= side_height && COLS >= FIELD_WIN_WIDTH + 1 + SIDE_WIDTH;
+  *fwin = fits ? newwin(FIELD_WIN_HEIGHT, FIELD_WIN_WIDTH, 0, 0) : NULL;
+  *swin = fits ? newwin(side_height, SIDE_WIDTH, 0, FIELD_WIN_WIDTH + 1) : NULL;
+  if (*fwin && *swin) {
+    wbkgd(*fwin, COLOR_PAIR(8));
+    wattron(*fwin, COLOR_WHITE);
+    box(*fwin, 0, 0);
+    wattroff(*fwin, COLOR_WHITE);
+    wrefresh(*fwin);
+
+    wbkgd(*swin, COLOR_PAIR(8));
+    box(*swin, 0, 0);
+    mvwprintw(*swin, 6, 2, "next:");
+  }
+  return *fwin && *swin;
+}
 
-  *swin = newwin(FIELD_HEIGHT + 2, 20, 0, FIELD_WIDTH * 2 + 3);
-  wbkgd(*swin, COLOR_PAIR(8));
-  box(*swin, 0, 0);
+/**
+ * @brief Забывает нарисованный кадр: при следующей отрисовке все клетки и
+ * значения будут выведены заново.
+ *
+ * @param screen Состояние экрана.
+ */
+void invalidateScreen(Screen_t *screen) {
+  memset(screen->field, 0xff, sizeof(screen->field));
+  memset(screen->next, 0xff, sizeof(screen->next));
+  screen->level = -1;
+  screen->score = -1;
+  screen->high_score = -1;
+  screen->pause = 0;
+  screen->sequence = 0;
 }
 
 /**
- * @brief Отрисовывает боковую панель со статистикой и следующей фигурой.
+ * @brief Рисует одну клетку шириной в два символа.
  *
- * @param side_win Окно боковой панели.
- * @param info     Текущая информация об игре.
+ * @param win Окно.
+ * @param y   Строка окна.
+ * @param x   Столбец окна.
+ * @param v   Цвет клетки, 0 — пусто, GHOST_CELL — тень, HINT_CELL —
+ * подсказка.
  */
-void DrawSideBar(WINDOW *side_win, GameInfo_t info) {
-  werase(side_win);
-  box(side_win, 0, 0);
-  mvwprintw(side_win, 1, 2, "level:      %4d", info.level);
-  mvwprintw(side_win, 3, 2, "score:      %4d", info.score);
-  mvwprintw(side_win, 4, 2, "high score: %4d", info.high_score);
-  mvwprintw(side_win, 6, 2, "next:");
+void DrawCell(WINDOW *win, int y, int x, int v) {
+  if (v == GHOST_CELL) {
+    mvwprintw(win, y, x, "[]");
+  } else if (v == HINT_CELL) {
+    mvwprintw(win, y, x, "<>");
+  } else if (v > 0) {
+    wattron(win, COLOR_PAIR(v));
+    mvwprintw(win, y, x, "  ");
+    wattroff(win, COLOR_PAIR(v));
+  } else {
+    mvwprintw(win, y, x, "  ");
+  }
+}
+
+/**
+ * @brief Обновляет на боковой панели статистику и следующую фигуру, которые
+ * изменились с прошлого кадра.
+ *
+ * @param screen Состояние экрана.
+ * @param frame  Кадр для отрисовки.
+ * @return true, если в окне что-то перерисовано.
+ */
+bool DrawSideBar(Screen_t *screen, const Frame_t *frame) {
+  WINDOW *win = screen->side_win;
+  bool changed = false;
+  if (frame->level != screen->level) {
+    mvwprintw(win, 1, 2, "level:      %4d", frame->level);
+    screen->level = frame->level;
+    changed = true;
+  }
+  if (frame->score != screen->score) {
+    mvwprintw(win, 3, 2, "score:      %4d", frame->score);
+    screen->score = frame->score;
+    changed = true;
+  }
+  if (frame->high_score != screen->high_score) {
+    mvwprintw(win, 4, 2, "high score: %4d", frame->high_score);
+    screen->high_score = frame->high_score;
+    changed = true;
+  }
   for (int i = 0; i < FIGURE_SIZE; i++) {
     for (int j = 0; j < FIGURE_SIZE; j++) {
-      int v = info.next[i][j];
-      if (v > 0) {
-        wattron(side_win, COLOR_PAIR(v));
-        mvwprintw(side_win, 8 + i, 2 + j * 2, "  ");
-        wattroff(side_win, COLOR_PAIR(v));
+      int v = frame->next[i][j];
+      if (v != screen->next[i][j]) {
+        DrawCell(win, 8 + i, 2 + j * 2, v);
+        screen->next[i][j] = v;
+        changed = true;
       }
     }
   }
-  wrefresh(side_win);
+  return changed;
 }
 
 /**
- * @brief Отрисовывает игровое поле с текущим расположением блоков.
+ * @brief Перерисовывает клетки игрового поля (вместе с тенью падающей
+ * фигуры и подсказкой), которые изменились с прошлого кадра. Тень и
+ * подсказка не перекрывают занятые клетки, подсказка перекрывает тень.
  *
- * @param game_win Окно игрового поля.
- * @param info     Текущая информация об игре.
+ * @param screen Состояние экрана.
+ * @param frame  Кадр для отрисовки.
+ * @return true, если в окне что-то перерисовано.
  */
-void DrawGameField(WINDOW *game_win, GameInfo_t info) {
-  werase(game_win);
-  box(game_win, 0, 0);
+bool DrawGameField(Screen_t *screen, const Frame_t *frame) {
+  bool changed = false;
   for (int y = 0; y < FIELD_HEIGHT; y++) {
     for (int x = 0; x < FIELD_WIDTH; x++) {
-      int v = info.field[y][x];
-      if (v > 0) {
-        wattron(game_win, COLOR_PAIR(v));
-        mvwprintw(game_win, y + 1, x * 2 + 1, "  ");
-        wattroff(game_win, COLOR_PAIR(v));
+      int v = frame->field[y][x];
+      for (int i = 0; !v && i < frame->hint_count; i++) {
+        if (frame->hint[i][0] == y && frame->hint[i][1] == x) v = HINT_CELL;
+      }
+      for (int i = 0; !v && i < frame->ghost_count; i++) {
+        if (frame->ghost[i][0] == y && frame->ghost[i][1] == x) v = GHOST_CELL;
+      }
+      if (v != screen->field[y][x]) {
+        DrawCell(screen->field_win, y + 1, x * 2 + 1, v);
+        screen->field[y][x] = v;
+        changed = true;
       }
     }
   }
-  wrefresh(game_win);
+  return changed;
 }
 
 /**
@@ -140,7 +218,7 @@ UserAction_t getButton(int userInput) {
     action = Action;
   } else if (userInput == 'p' || userInput == 'P') {
     action = Pause;
-  } else if (userInput == 27) {
+  } else if (userInput == KEY_ESC) {
     action = Terminate;
   } else {
     action = Up;
@@ -149,92 +227,620 @@ UserAction_t getButton(int userInput) {
 }
 
 /**
- * @brief Обрабатывает ввод пользователя и флаг завершения игры.
+ * @brief Создаёт очередь ввода, буфер кадров и неблокирующие каналы
+ * пробуждения потоков.
  *
- * Считывает последнюю нажатую клавишу, преобразует её в действие,
- * и при необходимости завершает главный цикл.
+ * @param[out] session Общие данные потоков.
+ * @return false, если каналы создать не удалось.
+ */
+bool sessionInit(Session_t *session) {
+  ringInit(&session->input);
+  frameBufferInit(&session->frames);
+  atomic_init(&session->hint, false);
+  bool ok = pipe(session->wake_logic) == 0;
+  if (ok && pipe(session->wake_ui) != 0) {
+    close(session->wake_logic[0]);
+    close(session->wake_logic[1]);
+    ok = false;
+  }
+  for (int i = 0; ok && i < 2; i++) {
+    fcntl(session->wake_logic[i], F_SETFL, O_NONBLOCK);
+    fcntl(session->wake_ui[i], F_SETFL, O_NONBLOCK);
+  }
+  return ok;
+}
+
+/**
+ * @brief Закрывает каналы пробуждения.
+ *
+ * @param session Общие данные потоков.
+ */
+void sessionClose(Session_t *session) {
+  for (int i = 0; i < 2; i++) {
+    close(session->wake_logic[i]);
+    close(session->wake_ui[i]);
+  }
+}
+
+/**
+ * @brief Будит поток, ждущий на канале. Если канал полон, поток и так
+ * проснётся, поэтому ошибка записи игнорируется.
+ *
+ * @param fd Пишущий конец канала.
+ */
+void wakeFd(int fd) {
+  char byte = 1;
+  ssize_t written = write(fd, &byte, 1);
+  (void)written;
+}
+
+/**
+ * @brief Вычитывает из канала все накопленные пробуждения.
  *
- * @param[out] action  Переменная для сохранения распознанного действия.
- * @param[out] running Флаг, указывающий, продолжается ли игра.
+ * @param fd Читающий конец канала.
  */
-void processInput(UserAction_t *action, bool *running) {
-  int ch = getch();
-  *action = getButton(ch);
-  if (*action == Terminate) {
-    *running = false;
+void drainFd(int fd) {
+  char buf[64];
+  while (read(fd, buf, sizeof(buf)) > 0) {
   }
 }
 
 /**
- * @brief Реализует «гравитацию»: по таймеру вызывает падение фигуры.
+ * @brief Вычитывает все клавиши, накопленные в буфере ncurses, и кладёт их
+ * в очередь ввода как действия с отметкой времени. Неизвестные клавиши
+ * отбрасываются.
+ *
+ * Остановка на первой клавише оставила бы остальные в буфере ncurses, и
+ * poll() не разбудил бы цикл до следующего нажатия. Если очередь полна,
+ * поток логики будится и интерфейс ждёт, пока освободится место. После
+ * Escape чтение прекращается: это последнее действие сессии. KEY_HINT не
+ * доходит до игры: он переключает подсказку и будит поток логики, чтобы
+ * тот опубликовал кадр с ней или без неё.
  *
- * @param[in,out] delay Текущий накопленный задержки.
- * @param[in]     gi    Указатель на информацию об игре (speed).
+ * @param session Общие данные потоков.
+ * @return false, если прочитан Escape.
  */
-void applyGravity(int *delay, const GameInfo_t *gi) {
-  *delay += 50;
-  if (*delay >= gi->speed) {
-    userInput(Up, false);
-    *delay = 0;
+bool readInput(Session_t *session) {
+  bool running = true;
+  bool pushed = false;
+  int ch;
+  while (running && (ch = getch()) != ERR) {
+    ActionEvent_t event = {getButton(ch), false, nowUs()};
+    if (ch == KEY_HINT || ch == 'H') {
+      atomic_store(&session->hint, !atomic_load(&session->hint));
+      pushed = true;
+    } else if (event.action != Up) {
+      while (!ringPush(&session->input, &event)) {
+        wakeFd(session->wake_logic[1]);
+        poll(NULL, 0, 1);
+      }
+      pushed = true;
+      running = event.action != Terminate;
+    }
+  }
+  if (pushed) wakeFd(session->wake_logic[1]);
+  return running;
+}
+
+/**
+ * @brief Забирает из очереди ввода не больше INPUT_BATCH_SIZE действий.
+ *
+ * @param      ring  Очередь ввода.
+ * @param[out] batch Пачка действий.
+ */
+void drainInput(ActionRing_t *ring, InputBatch_t *batch) {
+  batch->count = 0;
+  while (batch->count < INPUT_BATCH_SIZE &&
+         ringPop(ring, &batch->events[batch->count])) {
+    batch->count++;
+  }
+}
+
+/**
+ * @brief Схлопывает избыточные действия пачки, не меняя результата.
+ *
+ * Каждый шаг влево или вправо либо сдвигает фигуру, либо упирается, и после
+ * первого упора все следующие такие же шаги тоже ничего не делают, поэтому
+ * серия длиннее FIELD_WIDTH - 1 обрезается. Для поворотов то же верно после
+ * полного оборота без упора, поэтому серия из восьми и более поворотов
+ * сокращается на кратное ROTATION_COUNT. Две паузы подряд взаимно
+ * уничтожаются. От серии остаются её первые действия со своим временем:
+ * по нему shiftInput() отличает удержание от отдельных нажатий, а кадр
+ * считает задержку ввода.
+ *
+ * @param[in,out] batch Пачка действий.
+ */
+void coalesceInput(InputBatch_t *batch) {
+  int out = 0;
+  for (int i = 0; i < batch->count;) {
+    UserAction_t action = batch->events[i].action;
+    int run = 1;
+    while (i + run < batch->count && batch->events[i + run].action == action) {
+      run++;
+    }
+    int keep = run;
+    if (action == Left || action == Right) {
+      if (keep > FIELD_WIDTH - 1) keep = FIELD_WIDTH - 1;
+    } else if (action == Action) {
+      while (keep >= 2 * ROTATION_COUNT) keep -= ROTATION_COUNT;
+    } else if (action == Pause) {
+      keep = run % 2;
+    }
+    for (int k = 0; k < keep; k++) {
+      batch->events[out++] = batch->events[i + k];
+    }
+    i += run;
+  }
+  batch->count = out;
+}
+
+/**
+ * @brief Проводит игру через промежуточные состояния (очистка линий, спавн)
+ * до появления новой фигуры или конца игры. Иначе эти состояния поглотили бы
+ * следующие два действия игрока.
+ *
+ * @param[in,out] gravity Планировщик гравитации: разряжается, если появилась
+ * новая фигура.
+ */
+void settleState(Gravity_t *gravity) {
+  GameContext_t *gc = getContext();
+  while (gc->state == STATE_CLEARING || gc->state == STATE_SPAWN) {
+    stepGame(Up, false);
+    gravity->armed = false;
+  }
+}
+
+/**
+ * @brief Передаёт действие игре, предварительно выставив её часы по
+ * монотонному времени: от них отсчитываются автосдвиг и запись.
+ *
+ * @param action Действие пользователя.
+ * @param hold   Флаг удержания кнопки.
+ */
+void stepGame(UserAction_t action, bool hold) {
+  setContextClock(getContext(), (uint32_t)nowMs());
+  userInput(action, hold);
+}
+
+/**
+ * @brief Возвращает, до какого момента идёт автосдвиг удерживаемого
+ * направления: не дольше ARR после последнего повтора терминала, чтобы
+ * после отпускания клавиши фигура не проезжала лишние клетки, пока
+ * отпускание ещё не распознано.
+ *
+ * @param keys Состояние удержания (held != Up).
+ * @param now  Текущее время, мс.
+ * @return Момент по часам игры.
+ */
+static uint32_t shiftUntil(const KeyRepeat_t *keys, uint32_t now) {
+  uint32_t stop = (uint32_t)(keys->last_us / 1000) +
+                  getContext()->shift.arr_ms;
+  return (int32_t)(now - stop) > 0 ? stop : now;
+}
+
+/**
+ * @brief Отпускает удерживаемое направление в момент shiftUntil(), но не
+ * раньше часов игры: сдвиги после него не выполняются.
+ *
+ * @param keys Состояние удержания (held != Up).
+ */
+static void releaseHeld(KeyRepeat_t *keys) {
+  GameContext_t *gc = getContext();
+  uint32_t at = shiftUntil(keys, (uint32_t)nowMs());
+  if ((int32_t)(at - gc->clock_ms) > 0) setContextClock(gc, at);
+  userInput(keys->held, false);
+  keys->held = Up;
+}
+
+/**
+ * @brief Передаёт игре сдвиг влево/вправо как нажатие, удержание или
+ * одиночное нажатие.
+ *
+ * Терминал не сообщает об отпускании клавиш, поэтому удержание выводится из
+ * автоповтора терминала: удержанием считается третья подряд та же клавиша,
+ * если обе паузы перед ней короче release_ms. Две быстрые отдельные
+ * нажатия так остаются двумя сдвигами, а начальная задержка автоповтора
+ * терминала вместе с DAS игры задерживает автосдвиг. Нажатие другой
+ * стороны отпускает удерживаемую.
+ *
+ * @param keys  Состояние удержания.
+ * @param event Действие влево/вправо.
+ */
+void shiftInput(KeyRepeat_t *keys, const ActionEvent_t *event) {
+  if (keys->held != Up && keys->held != event->action) releaseHeld(keys);
+  bool repeat = keys->last == event->action &&
+                event->time_us - keys->last_us < keys->release_ms * 1000LL;
+  keys->repeats = repeat ? keys->repeats + 1 : 0;
+  if (keys->held == event->action) {
+    stepGame(event->action, true);
+  } else if (keys->repeats >= 2) {
+    keys->held = event->action;
+    stepGame(event->action, true);
+  } else {
+    stepGame(event->action, false);
+  }
+  keys->last = event->action;
+  keys->last_us = event->time_us;
+}
+
+/**
+ * @brief Отпускает удерживаемое направление, если автоповтор терминала
+ * прекратился, и выполняет наступившие автосдвиги, пока удержание ещё
+ * не истекло по shiftUntil().
+ *
+ * @param keys Состояние удержания.
+ */
+void applyKeyRepeat(KeyRepeat_t *keys) {
+  long long now = nowUs();
+  uint32_t until = (uint32_t)(now / 1000);
+  if (keys->held != Up) {
+    if (now - keys->last_us >= keys->release_ms * 1000LL) {
+      releaseHeld(keys);
+    } else {
+      until = shiftUntil(keys, until);
+    }
+  }
+  if ((int32_t)(until - getContext()->clock_ms) > 0) {
+    advanceContext(getContext(), until);
+  }
+}
+
+/**
+ * @brief Применяет действия из очереди ввода и обрабатывает флаг завершения
+ * игры. Вызывается потоком логики.
+ *
+ * Всё накопленное в очереди схлопывается и применяется за один проход;
+ * каждое применённое действие отмечается для ближайшего кадра, чтобы
+ * интерфейс мог посчитать задержку до его вывода.
+ *
+ * @param[in,out] logic   Состояние потока логики.
+ * @param[out]    running Флаг, указывающий, продолжается ли игра.
+ */
+void processInput(Logic_t *logic, bool *running) {
+  InputBatch_t batch;
+  do {
+    drainInput(&logic->session->input, &batch);
+    coalesceInput(&batch);
+    for (int i = 0; *running && i < batch.count; i++) {
+      const ActionEvent_t *event = &batch.events[i];
+      if (event->action == Terminate) {
+        *running = false;
+      } else {
+        settleState(&logic->gravity);
+        if (event->action == Left || event->action == Right) {
+          shiftInput(&logic->keys, event);
+        } else {
+          stepGame(event->action, false);
+        }
+        if (!logic->input_first_us) logic->input_first_us = event->time_us;
+        logic->inputs++;
+        logic->input_sum_us += event->time_us;
+      }
+    }
+  } while (*running && batch.count == INPUT_BATCH_SIZE);
+}
+
+/**
+ * @brief Находит первую посадку полной очистки поля, если она достижима
+ * за HINT_CLEAR_PIECES известных фигур. Поиск идёт один раз на фигуру:
+ * ключ решения — хеш поля без падающей фигуры, вид падающей, следующая и
+ * очередь, так что сдвиги и повороты фигуры его не сбрасывают. Решение
+ * ищется от положения фигуры при первом вызове, поэтому его первая
+ * посадка отдаётся, только пока она достижима из текущего положения.
+ *
+ * @param      logic Состояние потока логики.
+ * @param      gc    Указатель на контекст игры (STATE_FALLING).
+ * @param[out] first Посадка падающей фигуры.
+ * @return true, если решение есть и его первая посадка достижима.
+ */
+bool clearHint(Logic_t *logic, const GameContext_t *gc,
+               BotPlacement_t *first) {
+  BotBoard_t board;
+  botBoardInit(&board, gc);
+  uint64_t key = hashMix(board.hash ^ (uint64_t)(gc->current.piece + 1));
+  key = hashMix(key ^ (uint64_t)(gc->next_piece + 1));
+  for (int i = 0; i < gc->queue.count; i++) {
+    key = hashMix(key ^ (uint64_t)(queuePeek(&gc->queue, i) + 1));
+  }
+  if (logic->clear && key != logic->clear_key) {
+    logic->clear_key = key;
+    logic->clear_count = pcSolveGame(logic->clear, gc, HINT_CLEAR_PIECES,
+                                     logic->clear_plan);
+  }
+  bool found = false;
+  if (logic->clear && logic->clear_count > 0) {
+    BotPlacement_t moves[BOT_MAX_PLACEMENTS];
+    int n = botPlacements(&board, &gc->current, moves);
+    const Tetromino_t *want = &logic->clear_plan[0].piece;
+    for (int i = 0; i < n && !found; i++) {
+      found = !memcmp(&moves[i].piece, want, sizeof(*want));
+    }
+  }
+  if (found) *first = logic->clear_plan[0];
+  return found;
+}
+
+/**
+ * @brief Добавляет в кадр клетки посадки падающей фигуры: первой посадки
+ * полной очистки поля, если она найдена, иначе той, что выбрал бот.
+ *
+ * @param logic Состояние потока логики.
+ * @param gc    Указатель на контекст игры.
+ * @param frame Кадр.
+ */
+void captureHint(Logic_t *logic, const GameContext_t *gc, Frame_t *frame) {
+  BotPlacement_t best;
+  if (gc->state == STATE_FALLING &&
+      (clearHint(logic, gc, &best) ||
+       botChoose(gc, &bot_default_weights, &best))) {
+    const Tetromino_t *t = &best.piece;
+    const PieceShape_t *s = figureShape(t);
+    for (int i = 0; i < FIGURE_SIZE; i++) {
+      frame->hint[i][0] = (int8_t)(t->y + s->cells[i][0]);
+      frame->hint[i][1] = (int8_t)(t->x + s->cells[i][1]);
+    }
+    frame->hint_count = FIGURE_SIZE;
+  }
+}
+
+/**
+ * @brief Публикует кадр с текущим состоянием игры, отметками применённых
+ * действий и, если она включена, подсказкой и будит поток интерфейса.
+ *
+ * @param[in,out] logic Состояние потока логики.
+ */
+void publishFrame(Logic_t *logic) {
+  Frame_t *frame = frameBegin(&logic->session->frames);
+  captureFrame(getContext(), frame);
+  if (atomic_load_explicit(&logic->session->hint, memory_order_relaxed)) {
+    captureHint(logic, getContext(), frame);
+  }
+  frame->inputs = logic->inputs;
+  frame->input_sum_us = logic->input_sum_us;
+  frame->input_first_us = logic->input_first_us;
+  framePublish(&logic->session->frames);
+  logic->input_first_us = 0;
+  wakeFd(logic->session->wake_ui[1]);
+}
+
+/**
+ * @brief Поток логики: единственный владелец игры. Спит до ближайшего из
+ * шага гравитации, автосдвига, отпускания клавиши и нового ввода, после
+ * каждого пробуждения публикует кадр. Завершается по действию Terminate.
+ *
+ * @param arg Состояние потока логики (Logic_t).
+ * @return NULL.
+ */
+void *logicThread(void *arg) {
+  Logic_t *logic = arg;
+  int wake = logic->session->wake_logic[0];
+  stepGame(Start, false);
+  bool running = true;
+  while (running) {
+    applyKeyRepeat(&logic->keys);
+    applyGravity(&logic->gravity);
+    publishFrame(logic);
+    struct pollfd wake_fd = {wake, POLLIN, 0};
+    poll(&wake_fd, 1, waitTimeout(&logic->gravity, &logic->keys));
+    drainFd(wake);
+    processInput(logic, &running);
+  }
+  return NULL;
+}
+
+/**
+ * @brief Учитывает задержку действий, применённых с прошлого учтённого
+ * кадра. Если кадр не выводился, действия ничего не изменили на экране и не
+ * учитываются. Максимум берётся по самому раннему действию кадра, поэтому
+ * действия кадров, пропущенных интерфейсом, в него не попадают.
+ *
+ * @param[in,out] latency Статистика задержки ввода.
+ * @param         frame   Последний опубликованный кадр.
+ * @param         shown   Был ли выведен кадр.
+ */
+void recordLatency(Latency_t *latency, const Frame_t *frame, bool shown) {
+  uint64_t pending = frame->inputs - latency->inputs;
+  if (shown && pending) {
+    long long now = nowUs();
+    latency->count += (long)pending;
+    latency->total_us += now * (long long)pending -
+                         (frame->input_sum_us - latency->input_sum_us);
+    long long oldest = frame->input_first_us ? now - frame->input_first_us : 0;
+    if (oldest > latency->max_us) latency->max_us = oldest;
+  }
+  latency->inputs = frame->inputs;
+  latency->input_sum_us = frame->input_sum_us;
+}
+
+/**
+ * @brief Возвращает показания монотонных часов в микросекундах.
+ *
+ * @return Время в микросекундах от произвольной точки отсчёта.
+ */
+long long nowUs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * @brief Возвращает показания монотонных часов в миллисекундах.
+ *
+ * @return Время в миллисекундах от произвольной точки отсчёта.
+ */
+long long nowMs(void) { return nowUs() / 1000; }
+
+/**
+ * @brief Вычисляет, сколько главный цикл может спать в poll(): до ближайшего
+ * из шага гравитации, автосдвига и отпускания удерживаемой клавиши.
+ *
+ * @param gravity Планировщик гравитации.
+ * @param keys    Состояние удержания влево/вправо.
+ * @return Тайм-аут в миллисекундах; -1 — ждать ввода бесконечно (пауза,
+ * конец игры).
+ */
+int waitTimeout(const Gravity_t *gravity, const KeyRepeat_t *keys) {
+  const GameContext_t *gc = getContext();
+  long long now = nowMs();
+  long long wake = -1;
+  uint32_t shift;
+  if (gc->state == STATE_FALLING) {
+    wake = gravity->armed ? gravity->deadline : now;
+    if (shiftDeadline(gc, &shift) &&
+        (keys->held == Up || shiftUntil(keys, shift) == shift)) {
+      long long at = now + (int32_t)(shift - (uint32_t)now);
+      if (at < wake) wake = at;
+    }
+  }
+  if (keys->held != Up) {
+    long long release = keys->last_us / 1000 + keys->release_ms + 1;
+    if (wake < 0 || release < wake) wake = release;
+  }
+  int timeout = -1;
+  if (wake >= 0) {
+    long long left = wake - now;
+    timeout = left < 0 ? 0 : left > INT_MAX ? INT_MAX : (int)left;
+  }
+  return timeout;
+}
+
+/**
+ * @brief Читает тайминг в миллисекундах из переменной окружения.
+ *
+ * @param name     Имя переменной.
+ * @param fallback Значение, если переменная не задана или некорректна.
+ * @return Тайминг в миллисекундах.
+ */
+int envMs(const char *name, int fallback) {
+  const char *value = getenv(name);
+  char *end = NULL;
+  long ms = value ? strtol(value, &end, 10) : -1;
+  return value && end != value && *end == '\0' && ms >= 0 && ms <= 60000
+             ? (int)ms
+             : fallback;
+}
+
+/**
+ * @brief Реализует «гравитацию» по монотонным часам.
+ *
+ * Фигура опускается ровно раз в info.speed миллисекунд: дедлайн сдвигается
+ * на период, а не отсчитывается от момента пробуждения, поэтому задержки
+ * цикла не накапливаются. Промежуточные состояния (очистка линий, спавн)
+ * проходятся сразу. Пока фигура не падает (пауза, конец игры), планировщик
+ * разряжен; отсчёт заново начинается с появления фигуры или снятия паузы.
+ *
+ * @param[in,out] gravity Планировщик гравитации.
+ */
+void applyGravity(Gravity_t *gravity) {
+  GameContext_t *gc = getContext();
+  long long now = nowMs();
+  if (gc->state == STATE_FALLING && gravity->armed &&
+      now >= gravity->deadline) {
+    stepGame(Up, false);
+    gravity->deadline += gc->info.speed;
+    if (gravity->deadline <= now) gravity->deadline = now + gc->info.speed;
+  }
+  settleState(gravity);
+  if (gc->state != STATE_FALLING) {
+    gravity->armed = false;
+  } else if (!gravity->armed) {
+    gravity->deadline = now + gc->info.speed;
+    gravity->armed = true;
   }
 }
 
 /**
  * @brief Обновляет состояние экрана: поле, боковую панель и сообщения
- * паузы/конца игры.
+ * паузы/конца игры. Рисуются только изменения относительно прошлого кадра;
+ * если ничего не изменилось, терминал не обновляется вовсе.
+ *
+ * Кадр с тем же номером, что уже на экране, не сравнивается; после показа
+ * конца игры экран больше не меняется.
  *
- * @param field_win Окно игрового поля.
- * @param side_win  Окно боковой панели.
- * @param gi        Указатель на текущую информацию об игре (изменяется внутри).
+ * @param screen Состояние экрана.
+ * @param frame  Последний опубликованный кадр.
+ * @return true, если кадр выведен на терминал.
  */
-void render(WINDOW *field_win, WINDOW *side_win, GameInfo_t *gi) {
-  if (gi->pause != 2) {
-    *gi = updateCurrentState();
-    DrawSideBar(side_win, *gi);
-    DrawGameField(field_win, *gi);
+bool render(Screen_t *screen, const Frame_t *frame) {
+  if (screen->pause == 2 || frame->sequence == screen->sequence) return false;
+  screen->sequence = frame->sequence;
+  bool pause_changed = frame->pause != screen->pause;
+  if (pause_changed) {
+    /* Сообщение закрывает среднюю строку поля, после него её перерисуем. */
+    memset(screen->field[FIELD_HEIGHT / 2], 0xff,
+           sizeof(screen->field[FIELD_HEIGHT / 2]));
+    screen->pause = frame->pause;
   }
-  if (gi->pause == 1) {
-    mvwprintw(field_win, FIELD_HEIGHT / 2 + 1, (FIELD_WIDTH * 2 - 5) / 2 + 1,
-              "pause");
-    wrefresh(field_win);
-  } else if (gi->pause == 2) {
-    mvwprintw(field_win, FIELD_HEIGHT / 2 + 1, (FIELD_WIDTH * 2 - 5) / 2 + 1,
-              "game over");
-    wrefresh(field_win);
+  bool field_changed = DrawGameField(screen, frame);
+  bool side_changed = DrawSideBar(screen, frame);
+  if (frame->pause && (field_changed || pause_changed)) {
+    const char *message = frame->pause == 1 ? "pause" : "game over";
+    int len = (int)strlen(message);
+    if (len > FIELD_WIDTH * 2) len = FIELD_WIDTH * 2;
+    mvwaddnstr(screen->field_win, FIELD_HEIGHT / 2 + 1,
+               (FIELD_WIDTH * 2 - len) / 2 + 1, message, len);
+    field_changed = true;
   }
-  napms(50);
+  if (field_changed) wnoutrefresh(screen->field_win);
+  if (side_changed) wnoutrefresh(screen->side_win);
+  if (field_changed || side_changed) doupdate();
+  return field_changed || side_changed;
 }
 
 /**
- * @brief Точка входа в программу. Инициализирует окружение и запускает главный
- * цикл игры.
+ * @brief Точка входа в программу. Инициализирует окружение, запускает поток
+ * логики и ведёт в главном потоке ввод и отрисовку: клавиши уходят в
+ * очередь ввода, кадры приходят из буфера кадров, и ни один из потоков не
+ * ждёт другой.
  */
 int main() {
-  srand((unsigned)time(NULL));
+  static Session_t session;
+  if (!sessionInit(&session)) {
+    perror("pipe");
+    return 1;
+  }
+  seedContext(getContext(), (uint64_t)time(NULL), RANDOMIZER_UNIFORM);
+  setShiftTiming(getContext(), (uint16_t)envMs("TETRIS_DAS", FRONT_DAS_MS),
+                 (uint16_t)envMs("TETRIS_ARR", FRONT_ARR_MS));
 
   initNcurses();
   initColors();
 
-  WINDOW *game_win, *side_win;
-  createWindows(&game_win, &side_win);
-
-  userInput(Start, false);
-  GameInfo_t gi = updateCurrentState();
+  Screen_t screen;
+  if (!createWindows(&screen.field_win, &screen.side_win)) {
+    endwin();
+    fprintf(stderr, "terminal is too small: need %dx%d\n",
+            FIELD_WIN_WIDTH + 1 + SIDE_WIDTH,
+            FIELD_WIN_HEIGHT > SIDE_HEIGHT ? FIELD_WIN_HEIGHT : SIDE_HEIGHT);
+    sessionClose(&session);
+    return 1;
+  }
+  invalidateScreen(&screen);
 
-  int delay = 0;
-  bool running = true;
-  UserAction_t action;
+  Logic_t logic = {&session, {0, false},
+                   {Up, Up, 0, 0, envMs("TETRIS_RELEASE", RELEASE_MS)},
+                   0, 0, 0, pcCreate(HINT_CLEAR_NODES), 0, 0, {{{0}}}};
+  pthread_t thread;
+  bool running = pthread_create(&thread, NULL, logicThread, &logic) == 0;
+  bool started = running;
+  Latency_t latency = {0};
   while (running) {
-    processInput(&action, &running);
-    if (running) {
-      if (action != Up) {
-        userInput(action, false);
-      }
-      applyGravity(&delay, &gi);
-      render(game_win, side_win, &gi);
-    }
+    struct pollfd fds[2] = {{STDIN_FILENO, POLLIN, 0},
+                            {session.wake_ui[0], POLLIN, 0}};
+    poll(fds, 2, -1);
+    drainFd(session.wake_ui[0]);
+    running = readInput(&session);
+    const Frame_t *frame = frameAcquire(&session.frames);
+    recordLatency(&latency, frame, render(&screen, frame));
   }
+  if (started) pthread_join(thread, NULL);
+  pcDestroy(logic.clear);
 
   endwin();
-  return 0;
+  sessionClose(&session);
+  if (getenv("TETRIS_LATENCY") && latency.count) {
+    fprintf(stderr, "input latency: %ld actions, mean %lld us, max %lld us\n",
+            latency.count, latency.total_us / latency.count, latency.max_us);
+  }
+  return started ? 0 : 1;
 }
@@ -9,25 +9,189 @@
 #define COLOR_POWDER 14
 #define COLOR_GREY 15
 
+#include <fcntl.h>
+#include <limits.h>
 #include <locale.h>
 #include <ncurses.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "../../brick_game/tetris/backend.h"
+#include "../../brick_game/tetris/bot.h"
+#include "../../brick_game/tetris/frame.h"
 #include "../../brick_game/tetris/game.h"
+#include "../../brick_game/tetris/pc.h"
+#include "../../brick_game/tetris/ring.h"
 #ifdef __linux__
 #include <sys/random.h>
 #endif
 
+/** Размер окна поля: по две колонки терминала на клетку плюс рамка. */
+#define FIELD_WIN_WIDTH (FIELD_WIDTH * 2 + 2)
+#define FIELD_WIN_HEIGHT (FIELD_HEIGHT + 2)
+/** Ширина боковой панели и наименьшая высота, в которую влезает её текст. */
+#define SIDE_WIDTH 20
+#define SIDE_HEIGHT 13
+
+/** Значение клетки кадра, занятой тенью падающей фигуры. */
+#define GHOST_CELL (PIECE_COUNT + 1)
+/** Значение клетки кадра, занятой подсказкой бота. */
+#define HINT_CELL (PIECE_COUNT + 2)
+/**
+ * Подсказка полной очистки: наибольшее число фигур решения и предел узлов
+ * поиска, с которым он укладывается в десятки миллисекунд.
+ */
+#define HINT_CLEAR_PIECES 10
+#define HINT_CLEAR_NODES 20000
+
+/**
+ * Кадр, который сейчас выведен на экран. Каждая отрисовка сравнивает с ним
+ * новый опубликованный кадр и выводит только различия; -1 означает, что
+ * значение неизвестно и должно быть нарисовано. sequence — номер выведенного
+ * кадра.
+ */
+typedef struct Screen_t {
+  WINDOW *field_win;
+  WINDOW *side_win;
+  int field[FIELD_HEIGHT][FIELD_WIDTH];
+  int next[FIGURE_SIZE][FIGURE_SIZE];
+  int level, score, high_score;
+  int pause;
+  uint64_t sequence;
+} Screen_t;
+
+/**
+ * Планировщик гравитации: момент следующего шага по монотонным часам.
+ * Разряжен, пока фигура не падает.
+ */
+typedef struct Gravity_t {
+  long long deadline;
+  bool armed;
+} Gravity_t;
+
+/** Код клавиши Escape. */
+#define KEY_ESC 27
+/** Клавиша включения и выключения подсказки бота. */
+#define KEY_HINT 'h'
+/** Тайм-аут разбора escape-последовательностей, мс. */
+#define ESC_DELAY_MS 25
+/** Сколько действий поток логики забирает из очереди за один проход. */
+#define INPUT_BATCH_SIZE 64
+
+/** Действия, забранные из очереди ввода за один проход. */
+typedef struct InputBatch_t {
+  ActionEvent_t events[INPUT_BATCH_SIZE];
+  int count;
+} InputBatch_t;
+
+/**
+ * Тайминги удержания в терминале, мс: DAS и ARR, передаваемые игре, и
+ * тишина, после которой удерживаемая клавиша считается отпущенной.
+ * Переопределяются переменными TETRIS_DAS, TETRIS_ARR и TETRIS_RELEASE.
+ */
+#define FRONT_DAS_MS 50
+#define FRONT_ARR_MS 16
+#define RELEASE_MS 60
+
+/**
+ * Удержание влево/вправо, выведенное из автоповтора терминала: held —
+ * удерживаемое действие (Up — ничего), last и last_us — последнее действие
+ * влево/вправо и время его клавиши, repeats — сколько раз подряд оно
+ * пришло раньше чем через release_ms после предыдущего.
+ */
+typedef struct KeyRepeat_t {
+  UserAction_t held;
+  UserAction_t last;
+  long long last_us;
+  int repeats;
+  int release_ms;
+} KeyRepeat_t;
+
+/**
+ * Статистика задержки от чтения клавиши до вывода кадра. inputs и
+ * input_sum_us — счётчики действий из последнего кадра, учтённого
+ * статистикой.
+ */
+typedef struct Latency_t {
+  long count;
+  long long total_us, max_us;
+  uint64_t inputs;
+  int64_t input_sum_us;
+} Latency_t;
+
+/**
+ * Общие данные потоков ввода-вывода и логики. Поток интерфейса кладёт
+ * действия в input и будит поток логики записью в wake_logic; поток логики
+ * публикует кадры в frames и будит интерфейс записью в wake_ui. Каналы
+ * неблокирующие: байт в канале означает лишь «есть новое». hint
+ * переключает интерфейс, а поток логики, пока он поднят, добавляет в кадры
+ * посадку, выбранную ботом.
+ */
+typedef struct Session_t {
+  ActionRing_t input;
+  FrameBuffer_t frames;
+  int wake_logic[2];
+  int wake_ui[2];
+  atomic_bool hint;
+} Session_t;
+
+/**
+ * Состояние потока логики: он один владеет игрой, гравитацией и
+ * удержанием клавиш. inputs, input_sum_us и input_first_us — отметки
+ * применённых действий для ближайшего кадра (см. Frame_t). clear —
+ * решатель полной очистки для подсказки (NULL — без неё), clear_count —
+ * число фигур его решения clear_plan для поля и фигур с ключом clear_key
+ * (0 — решения нет).
+ */
+typedef struct Logic_t {
+  Session_t *session;
+  Gravity_t gravity;
+  KeyRepeat_t keys;
+  uint64_t inputs;
+  int64_t input_sum_us, input_first_us;
+  PcSolver_t *clear;
+  uint64_t clear_key;
+  int clear_count;
+  BotPlacement_t clear_plan[PC_MAX_PIECES];
+} Logic_t;
+
 void initNcurses();
 void initColors();
-void createWindows(WINDOW **fwin, WINDOW **swin);
+bool createWindows(WINDOW **fwin, WINDOW **swin);
 UserAction_t getButton(int userInput);
-void DrawSideBar(WINDOW *side_win, GameInfo_t info);
-void DrawGameField(WINDOW *game_win, GameInfo_t info);
-void processInput(UserAction_t *action, bool *running);
-void applyGravity(int *delay, const GameInfo_t *gi);
-void render(WINDOW *field_win, WINDOW *side_win, GameInfo_t *gi);
+void invalidateScreen(Screen_t *screen);
+void DrawCell(WINDOW *win, int y, int x, int v);
+bool DrawSideBar(Screen_t *screen, const Frame_t *frame);
+bool DrawGameField(Screen_t *screen, const Frame_t *frame);
+bool sessionInit(Session_t *session);
+void sessionClose(Session_t *session);
+void wakeFd(int fd);
+void drainFd(int fd);
+bool readInput(Session_t *session);
+void drainInput(ActionRing_t *ring, InputBatch_t *batch);
+void coalesceInput(InputBatch_t *batch);
+void settleState(Gravity_t *gravity);
+void stepGame(UserAction_t action, bool hold);
+void shiftInput(KeyRepeat_t *keys, const ActionEvent_t *event);
+void applyKeyRepeat(KeyRepeat_t *keys);
+void processInput(Logic_t *logic, bool *running);
+bool clearHint(Logic_t *logic, const GameContext_t *gc,
+               BotPlacement_t *first);
+void captureHint(Logic_t *logic, const GameContext_t *gc, Frame_t *frame);
+void publishFrame(Logic_t *logic);
+void *logicThread(void *arg);
+void recordLatency(Latency_t *latency, const Frame_t *frame, bool shown);
+long long nowUs(void);
+long long nowMs(void);
+int waitTimeout(const Gravity_t *gravity, const KeyRepeat_t *keys);
+int envMs(const char *name, int fallback);
+void applyGravity(Gravity_t *gravity);
+bool render(Screen_t *screen, const Frame_t *frame);
 
 #endif
\ No newline at end of file
@@ -1,10 +1,27 @@
 #include <check.h>
+#include <math.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "../brick_game/tetris/backend.h"
+#include "../brick_game/tetris/batch.h"
+#include "../brick_game/tetris/bot.h"
+#include "../brick_game/tetris/frame.h"
+#include "../brick_game/tetris/ring.h"
 #include "../brick_game/tetris/game.h"
+#include "../brick_game/tetris/pc.h"
+#include "../brick_game/tetris/replay.h"
+#include "../brick_game/tetris/search.h"
+
+static void placePiece(GameContext_t *gc, int piece, int rotation, int x,
+                       int y) {
+  gc->current.piece = (int8_t)piece;
+  gc->current.rotation = (int8_t)rotation;
+  gc->current.x = (int8_t)x;
+  gc->current.y = (int8_t)y;
+}
 
 START_TEST(test_getContext_singleton) {
   GameContext_t *a = getContext();
@@ -16,33 +33,227 @@ END_TEST
 
 START_TEST(test_nextCurrentInit_copies_next_and_color) {
   GameContext_t *gc = getContext();
-  for (int i = 0; i < FIGURE_SIZE; ++i)
-    for (int j = 0; j < FIGURE_SIZE; ++j)
-      gc->info.next[i][j] = (i == 2 && j == 1) ? 5 : 0;
+  gc->next_piece = 4;
+  gc->current.rotation = 3;
 
   nextCurrentInit(gc);
-  ck_assert_int_eq(gc->current.shape[2][1], 5);
-  ck_assert_int_eq(gc->current.color, 5);
+  ck_assert_int_eq(gc->current.piece, 4);
+  ck_assert_int_eq(gc->current.rotation, 0);
 
   gameOver(gc);
 }
 END_TEST
 
+START_TEST(test_nextFigureInit_fills_preview) {
+  GameContext_t *gc = getContext();
+  nextFigureInit(gc);
+  int cells = 0;
+  for (int i = 0; i < FIGURE_SIZE; ++i)
+    for (int j = 0; j < FIGURE_SIZE; ++j)
+      if (gc->preview[i][j]) {
+        ck_assert_int_eq(gc->preview[i][j], gc->next_piece + 1);
+        cells++;
+      }
+  ck_assert_int_eq(cells, 4);
+  gameOver(gc);
+}
+END_TEST
+
 START_TEST(test_clearLines_increment_score_and_compact) {
   GameContext_t *gc = getContext();
-  for (int j = 0; j < FIELD_WIDTH; ++j) gc->info.field[FIELD_HEIGHT - 1][j] = 1;
+  for (int j = 0; j < FIELD_WIDTH; ++j) setCell(gc, FIELD_HEIGHT - 1, j, 1);
   gc->info.score = 0;
 
   clearLines(gc);
   ck_assert_int_eq(gc->info.score, 100);
   for (int j = 0; j < FIELD_WIDTH; ++j)
-    ck_assert_int_eq(gc->info.field[0][j], 0);
+    ck_assert_int_eq(gc->cells[0][j], 0);
+
+  gameOver(gc);
+  remove("record.txt");
+}
+END_TEST
+
+START_TEST(test_clearLines_multiple_keeps_partial_rows) {
+  GameContext_t *gc = getContext();
+  for (int j = 0; j < FIELD_WIDTH; ++j) {
+    setCell(gc, FIELD_HEIGHT - 1, j, 1);
+    setCell(gc, FIELD_HEIGHT - 3, j, 2);
+  }
+  setCell(gc, FIELD_HEIGHT - 2, 1, 3);
+  setCell(gc, FIELD_HEIGHT - 4, FIELD_WIDTH - 1, 6);
+  gc->info.score = 0;
+
+  clearLines(gc);
+  ck_assert_int_eq(gc->info.score, 300);
+  ck_assert_int_eq(gc->cells[FIELD_HEIGHT - 1][1], 3);
+  ck_assert_int_eq(gc->cells[FIELD_HEIGHT - 2][FIELD_WIDTH - 1], 6);
+  ck_assert_uint_eq(gc->rows[FIELD_HEIGHT - 1], 1 << 1);
+  ck_assert_uint_eq(gc->rows[FIELD_HEIGHT - 2],
+                    (Row_t)((Row_t)1 << (FIELD_WIDTH - 1)));
+  ck_assert_int_eq(gc->rows[FIELD_HEIGHT - 3], 0);
+
+  gameOver(gc);
+  remove("record.txt");
+}
+END_TEST
+
+START_TEST(test_full_rows_tracked_by_draw_and_clear) {
+  GameContext_t *gc = getContext();
+  for (int j = FIGURE_SIZE; j < FIELD_WIDTH; ++j) {
+    setCell(gc, FIELD_HEIGHT - 1, j, 3);
+    setCell(gc, FIELD_HEIGHT - 4, j, 3);
+  }
+  ck_assert_uint_eq(gc->full_rows, 0);
+  placePiece(gc, 0, 0, 0, FIELD_HEIGHT - 1);
+  drawFigure(gc);
+  ck_assert_uint_eq(gc->full_rows, 1ull << (FIELD_HEIGHT - 1));
+  clearFigure(gc);
+  ck_assert_uint_eq(gc->full_rows, 0);
+  drawFigure(gc);
+  placePiece(gc, 0, 0, 0, FIELD_HEIGHT - 4);
+  drawFigure(gc);
+  setCell(gc, FIELD_HEIGHT - 2, FIELD_WIDTH - 1, 6);
+  gc->info.score = 0;
 
+  clearLines(gc);
+  ck_assert_int_eq(gc->info.score, 300);
+  ck_assert_uint_eq(gc->full_rows, 0);
+  ck_assert_int_eq(gc->cells[FIELD_HEIGHT - 1][FIELD_WIDTH - 1], 6);
+  ck_assert_uint_eq(gc->rows[FIELD_HEIGHT - 1],
+                    (Row_t)((Row_t)1 << (FIELD_WIDTH - 1)));
+  ck_assert_int_eq(gc->rows[FIELD_HEIGHT - 2], 0);
   gameOver(gc);
   remove("record.txt");
 }
 END_TEST
 
+START_TEST(test_heights_and_landing_row) {
+  GameContext_t *gc = createContext(NULL);
+  ck_assert_int_eq(gc->heights[1], FIELD_HEIGHT);
+  for (int j = 0; j < FIELD_WIDTH; ++j) setCell(gc, FIELD_HEIGHT - 1, j, 1);
+  setCell(gc, FIELD_HEIGHT - 2, 1, 2);
+  setCell(gc, FIELD_HEIGHT - 3, 1, 2);
+  ck_assert_int_eq(gc->heights[1], FIELD_HEIGHT - 3);
+  setCell(gc, FIELD_HEIGHT - 3, 1, 0);
+  ck_assert_int_eq(gc->heights[1], FIELD_HEIGHT - 2);
+  clearLines(gc);
+  ck_assert_int_eq(gc->heights[1], FIELD_HEIGHT - 1);
+  ck_assert_int_eq(gc->heights[0], FIELD_HEIGHT);
+
+  Tetromino_t i_piece = {0, 0, 0, 0};
+  ck_assert_int_eq(landingRow(gc, &i_piece), FIELD_HEIGHT - 2);
+  setCell(gc, FIELD_HEIGHT / 2, 3, 4);
+  Tetromino_t o_piece = {1, 0, 1, 0};
+  ck_assert_int_eq(landingRow(gc, &o_piece), FIELD_HEIGHT / 2 - 3);
+  o_piece.y = FIELD_HEIGHT / 2;
+  ck_assert_int_eq(landingRow(gc, &o_piece), FIELD_HEIGHT - 3);
+  destroyContext(gc);
+}
+END_TEST
+
+START_TEST(test_ghost_matches_hard_drop) {
+  GameConfig_t config = {42, RANDOMIZER_BAG};
+  GameContext_t *gc = createContext(&config);
+  int ghost[FIGURE_SIZE][2];
+  ck_assert_int_eq(ghostCells(gc, ghost), 0);
+  stepContext(gc, Start, false);
+  stepContext(gc, Up, false);
+  ck_assert_int_eq(gc->state, STATE_FALLING);
+  stepContext(gc, Left, false);
+  ck_assert_int_eq(ghostCells(gc, ghost), FIGURE_SIZE);
+  stepContext(gc, Down, false);
+  ck_assert_int_eq(gc->state, STATE_CLEARING);
+  for (int i = 0; i < FIGURE_SIZE; i++) {
+    int y = ghost[i][0];
+    int x = ghost[i][1];
+    ck_assert_int_eq(gc->cells[y][x], gc->current.piece + 1);
+    ck_assert_int_le(gc->heights[x], y);
+  }
+  destroyContext(gc);
+}
+END_TEST
+
+/* Горизонтальной I нужно место для сдвигов: поле от семи столбцов. */
+#if FIELD_WIDTH >= 7
+static GameContext_t *fallingIPiece(int x) {
+  GameContext_t *gc = createContext(NULL);
+  stepContext(gc, Start, false);
+  stepContext(gc, Up, false);
+  clearFigure(gc);
+  placePiece(gc, 0, 0, x, 5);
+  drawFigure(gc);
+  return gc;
+}
+
+START_TEST(test_auto_shift_das_and_arr) {
+  GameContext_t *gc = fallingIPiece(3);
+  uint32_t deadline = 0;
+  stepContext(gc, Left, true);
+  ck_assert_int_eq(gc->current.x, 2);
+  ck_assert(shiftDeadline(gc, &deadline));
+  ck_assert_uint_eq(deadline, DEFAULT_DAS_MS);
+  advanceContext(gc, DEFAULT_DAS_MS - 1);
+  ck_assert_int_eq(gc->current.x, 2);
+  advanceContext(gc, DEFAULT_DAS_MS);
+  ck_assert_int_eq(gc->current.x, 1);
+  stepContext(gc, Left, true);
+  ck_assert_int_eq(gc->current.x, 1);
+  advanceContext(gc, DEFAULT_DAS_MS + 5 * DEFAULT_ARR_MS);
+  ck_assert_int_eq(gc->current.x, 0);
+  ck_assert(!shiftDeadline(gc, &deadline));
+  ck_assert_int_eq(gc->cells[5][0], 1);
+
+  stepContext(gc, Left, false);
+  stepContext(gc, Right, false);
+  advanceContext(gc, 10000);
+  ck_assert_int_eq(gc->current.x, 1);
+  destroyContext(gc);
+}
+END_TEST
+#endif
+
+START_TEST(test_pieceRow_matches_cells) {
+  for (int p = 0; p < PIECE_COUNT; p++) {
+    for (int r = 0; r < ROTATION_COUNT; r++) {
+      const PieceShape_t *s = &tetromino_table[p][r];
+      Row_t rows[FIGURE_SIZE] = {0};
+      for (int i = 0; i < FIGURE_SIZE; i++) {
+        rows[s->cells[i][0] - s->top] |= (Row_t)(1u << s->cells[i][1]);
+      }
+      for (int i = 0; i < FIGURE_SIZE; i++) {
+        ck_assert_uint_eq(pieceRow(s, i, s->left), rows[i]);
+        ck_assert_uint_eq(pieceRow(s, i, FIELD_WIDTH - 1 - s->right + s->left),
+                          (Row_t)(rows[i] << (FIELD_WIDTH - 1 - s->right)));
+      }
+    }
+  }
+  Row_t full = 0;
+  for (int j = 0; j < FIELD_WIDTH; j++) full |= (Row_t)((Row_t)1 << j);
+  ck_assert_uint_eq(FULL_ROW, full);
+}
+END_TEST
+
+#if FIELD_WIDTH >= 7
+START_TEST(test_auto_shift_instant_stops_at_obstacle) {
+  GameContext_t *gc = fallingIPiece(1);
+  setShiftTiming(gc, 0, 0);
+  setCell(gc, 5, FIELD_WIDTH - 2, 7);
+  stepContext(gc, Right, true);
+  advanceContext(gc, 0);
+  ck_assert_int_eq(gc->current.x, FIELD_WIDTH - 6);
+  ck_assert_uint_eq(gc->rows[5], (Row_t)((Row_t)0xf << (FIELD_WIDTH - 6) |
+                                         (Row_t)1 << (FIELD_WIDTH - 2)));
+  stepContext(gc, Up, false);
+  ck_assert_int_eq(gc->current.x, FIELD_WIDTH - 6);
+  advanceContext(gc, 1);
+  ck_assert_int_eq(gc->current.x, FIELD_WIDTH - 4);
+  ck_assert_int_eq(gc->cells[6][FIELD_WIDTH - 1], 1);
+  destroyContext(gc);
+}
+END_TEST
+#endif
+
 START_TEST(test_gameOver_writes_record_and_sets_pause) {
   remove("record.txt");
   GameContext_t *gc = getContext();
@@ -62,14 +273,10 @@ END_TEST
 
 START_TEST(test_checkCollision_empty_board_in_bounds) {
   GameContext_t *gc = getContext();
-
-  memset(gc->current.shape, 0, sizeof(gc->current.shape));
-  gc->current.shape[0][0] = 1;
-  gc->current.x = 3;
-  gc->current.y = 5;
+  placePiece(gc, 2, 0, 0, 5);
 
   for (int i = 0; i < FIELD_HEIGHT; ++i)
-    for (int j = 0; j < FIELD_WIDTH; ++j) gc->info.field[i][j] = 0;
+    for (int j = 0; j < FIELD_WIDTH; ++j) setCell(gc, i, j, 0);
   ck_assert_int_eq(checkCollision(gc), 1);
   gameOver(getContext());
 }
@@ -77,10 +284,7 @@ END_TEST
 
 START_TEST(test_checkCollision_out_of_bounds_right) {
   GameContext_t *gc = getContext();
-  memset(gc->current.shape, 0, sizeof(gc->current.shape));
-  gc->current.shape[0][3] = 1;
-  gc->current.x = FIELD_WIDTH - 2;
-  gc->current.y = 0;
+  placePiece(gc, 0, 0, FIELD_WIDTH - 2, 0);
   ck_assert_int_eq(checkCollision(gc), 0);
   gameOver(getContext());
 }
@@ -88,16 +292,13 @@ END_TEST
 
 START_TEST(test_canFall_true_and_false) {
   GameContext_t *gc = getContext();
-  memset(gc->current.shape, 0, sizeof(gc->current.shape));
-  gc->current.shape[0][0] = 1;
-  gc->current.x = 0;
-  gc->current.y = 0;
+  placePiece(gc, 1, 0, 0, 0);
 
   for (int i = 0; i < FIELD_HEIGHT; ++i)
-    for (int j = 0; j < FIELD_WIDTH; ++j) gc->info.field[i][j] = 0;
+    for (int j = 0; j < FIELD_WIDTH; ++j) setCell(gc, i, j, 0);
   ck_assert(canFall(gc));
 
-  gc->info.field[1][0] = 1;
+  setCell(gc, 3, 1, 1);
   ck_assert(!canFall(gc));
   gameOver(getContext());
 }
@@ -105,75 +306,66 @@ END_TEST
 
 START_TEST(test_rotateTetromino_non_square) {
   GameContext_t *gc = getContext();
-
-  int L[4][4] = {{1, 0, 0, 0}, {1, 0, 0, 0}, {1, 1, 0, 0}, {0, 0, 0, 0}};
-  memcpy(gc->current.shape, L, sizeof(L));
+  placePiece(gc, 3, 0, 0, 0);
   rotateTetromino(gc);
 
-  ck_assert_int_eq(gc->current.shape[0][1], 1);
-  ck_assert_int_eq(gc->current.shape[0][2], 1);
-  ck_assert_int_eq(gc->current.shape[0][3], 1);
-  ck_assert_int_eq(gc->current.shape[1][1], 1);
+  ck_assert_int_eq(gc->current.rotation, 1);
+  const PieceShape_t *s = figureShape(&gc->current);
+  int expected[FIGURE_SIZE][2] = {{0, 2}, {0, 3}, {1, 2}, {2, 2}};
+  for (int i = 0; i < FIGURE_SIZE; ++i) {
+    ck_assert_int_eq(s->cells[i][0], expected[i][0]);
+    ck_assert_int_eq(s->cells[i][1], expected[i][1]);
+  }
+  for (int i = 0; i < 3; ++i) rotateTetromino(gc);
+  ck_assert_int_eq(gc->current.rotation, 0);
   gameOver(getContext());
 }
 END_TEST
 
 START_TEST(test_draw_and_clear_figure) {
   GameContext_t *gc = getContext();
-
-  memset(gc->current.shape, 0, sizeof(gc->current.shape));
-  gc->current.shape[0][0] = gc->current.shape[0][1] = gc->current.shape[1][0] =
-      gc->current.shape[1][1] = 1;
-  gc->current.color = 7;
-  gc->current.x = 2;
-  gc->current.y = 3;
+  placePiece(gc, 1, 0, 1, 3);
 
   for (int i = 0; i < FIELD_HEIGHT; ++i)
-    for (int j = 0; j < FIELD_WIDTH; ++j) gc->info.field[i][j] = 0;
+    for (int j = 0; j < FIELD_WIDTH; ++j) setCell(gc, i, j, 0);
   drawFigure(gc);
 
-  ck_assert_int_eq(gc->info.field[3][2], 7);
-  ck_assert_int_eq(gc->info.field[3][3], 7);
-  ck_assert_int_eq(gc->info.field[4][2], 7);
-  ck_assert_int_eq(gc->info.field[4][3], 7);
+  ck_assert_int_eq(gc->cells[4][2], 2);
+  ck_assert_int_eq(gc->cells[4][3], 2);
+  ck_assert_int_eq(gc->cells[5][2], 2);
+  ck_assert_int_eq(gc->cells[5][3], 2);
+  ck_assert_int_eq(gc->rows[4], 0xc);
   clearFigure(gc);
-  ck_assert_int_eq(gc->info.field[3][2], 0);
-  ck_assert_int_eq(gc->info.field[4][3], 0);
+  ck_assert_int_eq(gc->cells[4][2], 0);
+  ck_assert_int_eq(gc->cells[5][3], 0);
+  ck_assert_int_eq(gc->rows[4], 0);
   gameOver(getContext());
 }
 END_TEST
 
 START_TEST(test_trySpawnFigure_collision_prevents_draw) {
   GameContext_t *gc = getContext();
+  placePiece(gc, 1, 0, 0, 0);
 
-  memset(gc->current.shape, 0, sizeof(gc->current.shape));
-  gc->current.shape[0][0] = 1;
-  gc->current.color = 4;
-  gc->current.x = 0;
-  gc->current.y = 0;
-
-  gc->info.field[0][0] = 9;
+  setCell(gc, 1, 1, 9);
 
   ck_assert_int_eq(trySpawnFigure(gc), 0);
 
-  ck_assert_int_eq(gc->info.field[0][0], 9);
+  ck_assert_int_eq(gc->cells[1][1], 9);
+  ck_assert_int_eq(gc->cells[1][2], 0);
   gameOver(getContext());
 }
 END_TEST
 
 START_TEST(test_autoMoveDown_changes_state_on_collision) {
   GameContext_t *gc = getContext();
-  memset(gc->current.shape, 0, sizeof(gc->current.shape));
-  gc->current.shape[0][0] = 1;
-  gc->current.color = 3;
-  gc->current.x = 0;
-  gc->current.y = FIELD_HEIGHT - 2;
+  placePiece(gc, 1, 0, 0, FIELD_HEIGHT - 4);
 
-  gc->info.field[FIELD_HEIGHT - 1][0] = 5;
+  setCell(gc, FIELD_HEIGHT - 1, 1, 5);
   gc->state = STATE_FALLING;
   autoMoveDown(gc);
 
-  ck_assert_int_eq(gc->current.y, FIELD_HEIGHT - 2);
+  ck_assert_int_eq(gc->current.y, FIELD_HEIGHT - 4);
   ck_assert_int_eq(gc->state, STATE_CLEARING);
   gameOver(getContext());
 }
@@ -181,18 +373,14 @@ END_TEST
 
 START_TEST(test_autoMoveDown_moves_down_if_free) {
   GameContext_t *gc = getContext();
-  memset(gc->current.shape, 0, sizeof(gc->current.shape));
-  gc->current.shape[0][0] = 1;
-  gc->current.color = 2;
-  gc->current.x = 1;
-  gc->current.y = 1;
+  placePiece(gc, 1, 0, 1, 1);
   for (int i = 0; i < FIELD_HEIGHT; i++)
-    for (int j = 0; j < FIELD_WIDTH; j++) gc->info.field[i][j] = 0;
+    for (int j = 0; j < FIELD_WIDTH; j++) setCell(gc, i, j, 0);
   gc->state = STATE_FALLING;
   autoMoveDown(gc);
   ck_assert_int_eq(gc->current.y, 2);
   ck_assert_int_eq(gc->state, STATE_FALLING);
-  ck_assert_int_eq(gc->info.field[2][1], 2);
+  ck_assert_int_eq(gc->cells[3][2], 2);
   gameOver(getContext());
 }
 END_TEST
@@ -200,15 +388,12 @@ END_TEST
 START_TEST(test_fallingHandler_left_moves_left) {
   GameContext_t *gc = getContext();
   for (int i = 0; i < FIELD_HEIGHT; ++i) {
-    memset(gc->info.field[i], 0, FIELD_WIDTH * sizeof(int));
+    for (int j = 0; j < FIELD_WIDTH; ++j) setCell(gc, i, j, 0);
   }
-  memset(gc->current.shape, 0, sizeof gc->current.shape);
-  gc->current.shape[0][0] = 1;
-  gc->current.x = 5;
-  gc->current.y = 5;
+  placePiece(gc, 1, 0, 1, 5);
   gc->state = STATE_FALLING;
   fallingHandler(gc, Left);
-  ck_assert_int_eq(gc->current.x, 4);
+  ck_assert_int_eq(gc->current.x, 0);
   gameOver(getContext());
 }
 END_TEST
@@ -216,12 +401,9 @@ END_TEST
 START_TEST(test_fallingHandler_left_blocked_at_zero) {
   GameContext_t *gc = getContext();
   for (int i = 0; i < FIELD_HEIGHT; ++i) {
-    memset(gc->info.field[i], 0, FIELD_WIDTH * sizeof(int));
+    for (int j = 0; j < FIELD_WIDTH; ++j) setCell(gc, i, j, 0);
   }
-  memset(gc->current.shape, 0, sizeof gc->current.shape);
-  gc->current.shape[0][0] = 1;
-  gc->current.x = 0;
-  gc->current.y = 5;
+  placePiece(gc, 0, 0, 0, 5);
   gc->state = STATE_FALLING;
   fallingHandler(gc, Left);
   ck_assert_int_eq(gc->current.x, 0);
@@ -232,15 +414,12 @@ END_TEST
 START_TEST(test_fallingHandler_right_moves_right) {
   GameContext_t *gc = getContext();
   for (int i = 0; i < FIELD_HEIGHT; ++i) {
-    memset(gc->info.field[i], 0, FIELD_WIDTH * sizeof(int));
+    for (int j = 0; j < FIELD_WIDTH; ++j) setCell(gc, i, j, 0);
   }
-  memset(gc->current.shape, 0, sizeof gc->current.shape);
-  gc->current.shape[0][0] = 1;
-  gc->current.x = 3;
-  gc->current.y = 4;
+  placePiece(gc, 1, 0, 0, 4);
   gc->state = STATE_FALLING;
   fallingHandler(gc, Right);
-  ck_assert_int_eq(gc->current.x, 4);
+  ck_assert_int_eq(gc->current.x, 1);
   gameOver(getContext());
 }
 END_TEST
@@ -248,12 +427,9 @@ END_TEST
 START_TEST(test_fallingHandler_right_blocked_at_edge) {
   GameContext_t *gc = getContext();
   for (int i = 0; i < FIELD_HEIGHT; ++i) {
-    memset(gc->info.field[i], 0, FIELD_WIDTH * sizeof(int));
+    for (int j = 0; j < FIELD_WIDTH; ++j) setCell(gc, i, j, 0);
   }
-  memset(gc->current.shape, 0, sizeof gc->current.shape);
-  gc->current.shape[0][FIGURE_SIZE - 1] = 1;
-  gc->current.x = FIELD_WIDTH - FIGURE_SIZE;
-  gc->current.y = 0;
+  placePiece(gc, 0, 0, FIELD_WIDTH - FIGURE_SIZE, 0);
   gc->state = STATE_FALLING;
   fallingHandler(gc, Right);
   ck_assert_int_eq(gc->current.x, FIELD_WIDTH - FIGURE_SIZE);
@@ -264,16 +440,14 @@ END_TEST
 START_TEST(test_fallingHandler_down_locks_and_clearing) {
   GameContext_t *gc = getContext();
   for (int i = 0; i < FIELD_HEIGHT; ++i) {
-    memset(gc->info.field[i], 0, FIELD_WIDTH * sizeof(int));
+    for (int j = 0; j < FIELD_WIDTH; ++j) setCell(gc, i, j, 0);
   }
-  memset(gc->current.shape, 0, sizeof gc->current.shape);
-  gc->current.shape[0][0] = 1;
-  gc->current.x = 0;
-  gc->current.y = FIELD_HEIGHT - 2;
-  gc->info.field[FIELD_HEIGHT - 1][0] = 1;
+  placePiece(gc, 1, 0, 0, 0);
+  setCell(gc, FIELD_HEIGHT - 1, 1, 1);
   gc->state = STATE_FALLING;
   fallingHandler(gc, Down);
   ck_assert_int_eq(gc->state, STATE_CLEARING);
+  ck_assert_int_eq(gc->current.y, FIELD_HEIGHT - 4);
   gameOver(getContext());
 }
 END_TEST
@@ -281,17 +455,26 @@ END_TEST
 START_TEST(test_fallingHandler_action_rotates_when_no_collision) {
   GameContext_t *gc = getContext();
   for (int i = 0; i < FIELD_HEIGHT; ++i) {
-    memset(gc->info.field[i], 0, FIELD_WIDTH * sizeof(int));
+    for (int j = 0; j < FIELD_WIDTH; ++j) setCell(gc, i, j, 0);
+  }
+  placePiece(gc, 2, 0, 0, 3);
+  gc->state = STATE_FALLING;
+  fallingHandler(gc, Action);
+  ck_assert_int_eq(gc->current.rotation, 1);
+  gameOver(getContext());
+}
+END_TEST
+
+START_TEST(test_fallingHandler_action_blocked_keeps_rotation) {
+  GameContext_t *gc = getContext();
+  for (int i = 0; i < FIELD_HEIGHT; ++i) {
+    for (int j = 0; j < FIELD_WIDTH; ++j) setCell(gc, i, j, 0);
   }
-  memset(gc->current.shape, 0, sizeof gc->current.shape);
-  gc->current.shape[0][1] = 1;
-  gc->current.x = 0;
-  gc->current.y = 0;
+  placePiece(gc, 0, 0, 0, FIELD_HEIGHT - 1);
   gc->state = STATE_FALLING;
-  int original[FIGURE_SIZE][FIGURE_SIZE];
-  memcpy(original, gc->current.shape, sizeof original);
   fallingHandler(gc, Action);
-  ck_assert(memcmp(gc->current.shape, original, sizeof original) != 0);
+  ck_assert_int_eq(gc->current.rotation, 0);
+  ck_assert_int_eq(gc->cells[FIELD_HEIGHT - 1][3], 1);
   gameOver(getContext());
 }
 END_TEST
@@ -321,12 +504,9 @@ END_TEST
 START_TEST(test_fallingHandler_up_calls_autoMoveDown) {
   GameContext_t *gc = getContext();
   for (int i = 0; i < FIELD_HEIGHT; ++i) {
-    memset(gc->info.field[i], 0, FIELD_WIDTH * sizeof(int));
+    for (int j = 0; j < FIELD_WIDTH; ++j) setCell(gc, i, j, 0);
   }
-  memset(gc->current.shape, 0, sizeof gc->current.shape);
-  gc->current.shape[0][0] = 1;
-  gc->current.x = 2;
-  gc->current.y = 2;
+  placePiece(gc, 1, 0, 1, 2);
   gc->state = STATE_FALLING;
   fallingHandler(gc, Up);
   ck_assert_int_eq(gc->current.y, 3);
@@ -349,7 +529,7 @@ START_TEST(test_userInputHandler_spawn_success) {
   GameContext_t *gc = getContext();
   gc->state = STATE_SPAWN;
   for (int i = 0; i < FIELD_HEIGHT; ++i) {
-    memset(gc->info.field[i], 0, FIELD_WIDTH * sizeof(int));
+    for (int j = 0; j < FIELD_WIDTH; ++j) setCell(gc, i, j, 0);
   }
   userInputHandler(Left);
   ck_assert_int_eq(gc->state, STATE_FALLING);
@@ -414,7 +594,7 @@ END_TEST
 START_TEST(test_userInputHandler_clearing_to_spawn) {
   GameContext_t *gc = getContext();
   gc->state = STATE_CLEARING;
-  for (int j = 0; j < FIELD_WIDTH; ++j) gc->info.field[FIELD_HEIGHT - 1][j] = 1;
+  for (int j = 0; j < FIELD_WIDTH; ++j) setCell(gc, FIELD_HEIGHT - 1, j, 1);
   gc->info.score = 0;
   userInputHandler(Left);
   ck_assert_int_eq(gc->state, STATE_SPAWN);
@@ -424,12 +604,847 @@ START_TEST(test_userInputHandler_clearing_to_spawn) {
 }
 END_TEST
 
+START_TEST(test_initContext_expands_colors_at_query) {
+  static GameContext_t gc;
+  static InfoView_t view;
+  GameConfig_t config = {3, RANDOMIZER_BAG};
+  initContext(&gc, &config);
+  ck_assert_uint_eq((uintptr_t)&gc % CONTEXT_ALIGN, 0);
+  /* Сверх массивов поля — не больше, чем у поля 10x20 в восьми строках
+     кеша. */
+  size_t board = sizeof(gc.rows) + sizeof(gc.cells) + sizeof(gc.heights);
+  size_t board10x20 = (20 + FIGURE_SIZE) * sizeof(uint16_t) + 20 * 10 + 10;
+  size_t lines =
+      (8 * CONTEXT_ALIGN - board10x20 + board + CONTEXT_ALIGN - 1) /
+      CONTEXT_ALIGN;
+  ck_assert_uint_le(sizeof(GameContext_t), lines * CONTEXT_ALIGN);
+  for (int j = 0; j < FIELD_WIDTH; ++j) {
+    setCell(&gc, FIELD_HEIGHT - 1, j, 1);
+  }
+  setCell(&gc, FIELD_HEIGHT - 2, 2, 5);
+  clearLines(&gc);
+  ck_assert_int_eq(gc.cells[FIELD_HEIGHT - 1][2], 5);
+  GameInfo_t info = queryContext(&gc, &view);
+  ck_assert_int_eq(info.field[FIELD_HEIGHT - 1][2], 5);
+  ck_assert_int_eq(info.score, gc.info.score);
+  int preview = 0;
+  for (int i = 0; i < FIGURE_SIZE; i++) {
+    for (int j = 0; j < FIGURE_SIZE; j++) {
+      ck_assert_int_eq(info.next[i][j], gc.preview[i][j]);
+      preview += info.next[i][j] != 0;
+    }
+  }
+  ck_assert_int_eq(preview, FIGURE_SIZE);
+  resetContext(&gc);
+  ck_assert_int_eq(gc.cells[FIELD_HEIGHT - 1][2], 0);
+  ck_assert_int_eq(info.field[FIELD_HEIGHT - 1][2], 5);
+}
+END_TEST
+
+static void countingSink(int score, void *data) { *(int *)data = score; }
+
+START_TEST(test_createContext_instances_are_independent) {
+  GameConfig_t config = {1, RANDOMIZER_UNIFORM};
+  GameContext_t *a = createContext(&config);
+  GameContext_t *b = createContext(&config);
+  ck_assert_ptr_nonnull(a);
+  ck_assert_ptr_ne(a, b);
+  ck_assert_ptr_ne(a, getContext());
+  ck_assert_int_eq(a->next_piece, b->next_piece);
+
+  stepContext(a, Start, false);
+  stepContext(a, Left, false);
+  ck_assert_int_eq(a->state, STATE_FALLING);
+  ck_assert_int_eq(b->state, STATE_START);
+  InfoView_t va, vb;
+  GameInfo_t ia = queryContext(a, &va);
+  GameInfo_t ib = queryContext(b, &vb);
+  ck_assert_ptr_ne(ia.field, ib.field);
+  int filled_a = 0, filled_b = 0;
+  for (int i = 0; i < FIELD_HEIGHT; i++) {
+    for (int j = 0; j < FIELD_WIDTH; j++) {
+      filled_a += ia.field[i][j] != 0;
+      filled_b += ib.field[i][j] != 0;
+    }
+  }
+  ck_assert_int_eq(filled_a, FIGURE_SIZE);
+  ck_assert_int_eq(filled_b, 0);
+
+  destroyContext(a);
+  destroyContext(b);
+}
+END_TEST
+
+START_TEST(test_createContext_uses_own_high_score_sink) {
+  remove("record.txt");
+  GameContext_t *gc = createContext(NULL);
+  int reported = -1;
+  setHighScoreSink(gc, countingSink, &reported);
+  for (int j = 0; j < FIELD_WIDTH; ++j) setCell(gc, FIELD_HEIGHT - 1, j, 1);
+  clearLines(gc);
+  ck_assert_int_eq(reported, 100);
+  ck_assert_int_eq(gc->info.high_score, 100);
+  FILE *f = fopen("record.txt", "r");
+  ck_assert_ptr_null(f);
+
+  resetContext(gc);
+  ck_assert_int_eq(gc->info.score, 0);
+  ck_assert_int_eq(gc->info.high_score, 100);
+  ck_assert_int_eq(gc->state, STATE_START);
+  ck_assert_int_eq(gc->rows[FIELD_HEIGHT - 1], 0);
+  destroyContext(gc);
+}
+END_TEST
+
+START_TEST(test_rng_same_seed_same_sequence) {
+  Rng_t a, b;
+  rngSeed(&a, 42);
+  rngSeed(&b, 42);
+  for (int i = 0; i < 100; ++i) ck_assert_uint_eq(rngNext(&a), rngNext(&b));
+  rngSeed(&b, 43);
+  ck_assert_uint_ne(rngNext(&a), rngNext(&b));
+  for (int i = 0; i < 1000; ++i) ck_assert_uint_eq(rngBounded(&a, 7) < 7, 1);
+}
+END_TEST
+
+START_TEST(test_queue_bag_contains_each_piece_once) {
+  PieceQueue_t q;
+  queueInit(&q, 5, RANDOMIZER_BAG);
+  for (int bag = 0; bag < 10; ++bag) {
+    int seen[BAG_SIZE] = {0};
+    ck_assert_int_ge(q.count, BAG_SIZE);
+    for (int i = 0; i < BAG_SIZE; ++i) {
+      ck_assert_int_eq(queuePeek(&q, i), q.pieces[(q.head + i) % 16]);
+      seen[queuePop(&q)]++;
+    }
+    for (int i = 0; i < BAG_SIZE; ++i) ck_assert_int_eq(seen[i], 1);
+  }
+}
+END_TEST
+
+START_TEST(test_seedContext_reproduces_piece_sequence) {
+  GameConfig_t config = {99, RANDOMIZER_BAG};
+  GameContext_t *a = createContext(&config);
+  GameContext_t *b = createContext(NULL);
+  seedContext(b, 99, RANDOMIZER_BAG);
+  for (int i = 0; i < 50; ++i) {
+    ck_assert_int_eq(a->current.piece, b->current.piece);
+    ck_assert_int_eq(a->next_piece, b->next_piece);
+    nextCurrentInit(a);
+    nextFigureInit(a);
+    nextCurrentInit(b);
+    nextFigureInit(b);
+  }
+  destroyContext(a);
+  destroyContext(b);
+}
+END_TEST
+
+static void recordScriptedGame(Replay_t *r, GameContext_t *gc) {
+  const UserAction_t moves[] = {Left, Action, Right, Right, Up, Down};
+  replayStart(r, gc, 2024, RANDOMIZER_BAG, 3);
+  stepContext(gc, Start, false);
+  for (int i = 0; gc->state != STATE_GAME_OVER && i < 600; ++i) {
+    setContextClock(gc, gc->clock_ms + (uint32_t)(i % 7 == 0 ? 700 : 5));
+    stepContext(gc, moves[i % 6], i % 5 == 0);
+  }
+  replayFinish(r, gc);
+}
+
+START_TEST(test_replay_roundtrip_and_verify) {
+  GameContext_t *gc = createContext(NULL);
+  Replay_t r;
+  recordScriptedGame(&r, gc);
+  ck_assert_int_gt(r.event_count, 30);
+  ck_assert_int_gt(r.keyframe_count, 2);
+  ck_assert(replayVerify(&r));
+  ck_assert(replaySave(&r, "replay_test.bin"));
+
+  Replay_t loaded;
+  ck_assert(replayLoad(&loaded, "replay_test.bin"));
+  ck_assert_uint_eq(loaded.seed, 2024);
+  ck_assert_uint_eq(loaded.das_ms, DEFAULT_DAS_MS);
+  ck_assert_uint_eq(loaded.arr_ms, DEFAULT_ARR_MS);
+  ck_assert_uint_eq(loaded.event_count, r.event_count);
+  ck_assert_uint_eq(loaded.keyframe_count, r.keyframe_count);
+  ck_assert_mem_eq(loaded.events, r.events, r.size);
+  ck_assert(replayVerify(&loaded));
+
+  loaded.final_score += 100;
+  ck_assert(!replayVerify(&loaded));
+
+  replayFree(&loaded);
+  replayFree(&r);
+  destroyContext(gc);
+  remove("replay_test.bin");
+}
+END_TEST
+
+START_TEST(test_replay_load_rejects_corrupt_files) {
+  GameContext_t *gc = createContext(NULL);
+  Replay_t r, loaded;
+  recordScriptedGame(&r, gc);
+
+  Tetromino_t current = r.keyframes[1].snapshot.current;
+  r.keyframes[1].snapshot.current.piece = PIECE_COUNT;
+  ck_assert(replaySave(&r, "replay_test.bin"));
+  ck_assert(!replayLoad(&loaded, "replay_test.bin"));
+  r.keyframes[1].snapshot.current = current;
+  r.keyframes[1].snapshot.next_piece = -1;
+  ck_assert(replaySave(&r, "replay_test.bin"));
+  ck_assert(!replayLoad(&loaded, "replay_test.bin"));
+  r.keyframes[1].snapshot.next_piece = 0;
+  r.keyframes[1].snapshot.shift.direction = 100;
+  ck_assert(replaySave(&r, "replay_test.bin"));
+  ck_assert(!replayLoad(&loaded, "replay_test.bin"));
+  r.keyframes[1].snapshot.shift.direction = 0;
+
+  r.randomizer = (Randomizer_t)(RANDOMIZER_BAG + 1);
+  ck_assert(replaySave(&r, "replay_test.bin"));
+  ck_assert(!replayLoad(&loaded, "replay_test.bin"));
+  r.randomizer = RANDOMIZER_BAG;
+
+  r.lost = true;
+  remove("replay_test.bin");
+  ck_assert(!replaySave(&r, "replay_test.bin"));
+  ck_assert(!replayLoad(&loaded, "replay_test.bin"));
+  r.lost = false;
+
+  /* Число ключевых кадров 2^61 + 1: произведение на размер кадра
+   * переполняется. */
+  uint32_t keyframes = r.keyframe_count;
+  r.keyframe_count = 0;
+  ck_assert(replaySave(&r, "replay_test.bin"));
+  r.keyframe_count = keyframes;
+  const uint8_t huge[] = {0x81, 0x80, 0x80, 0x80, 0x80,
+                          0x80, 0x80, 0x80, 0x20};
+  FILE *f = fopen("replay_test.bin", "r+b");
+  ck_assert_ptr_nonnull(f);
+  fseek(f, -1, SEEK_END);
+  fwrite(huge, 1, sizeof(huge), f);
+  fclose(f);
+  ck_assert(!replayLoad(&loaded, "replay_test.bin"));
+
+  replayFree(&r);
+  destroyContext(gc);
+  remove("replay_test.bin");
+}
+END_TEST
+
+START_TEST(test_replay_seek_matches_full_playback) {
+  GameContext_t *gc = createContext(NULL);
+  Replay_t r;
+  recordScriptedGame(&r, gc);
+  uint32_t target = r.keyframes[1].event_index + 7;
+
+  GameContext_t *a = createContext(NULL);
+  GameContext_t *b = createContext(NULL);
+  ck_assert_uint_eq(replaySeek(&r, a, target), target);
+  Replay_t nokeys = r;
+  nokeys.keyframe_count = 0;
+  ck_assert_uint_eq(replaySeek(&nokeys, b, target), target);
+
+  ContextSnapshot_t sa, sb;
+  saveSnapshot(a, &sa);
+  saveSnapshot(b, &sb);
+  ck_assert_mem_eq(&sa, &sb, sizeof(sa));
+
+  destroyContext(a);
+  destroyContext(b);
+  replayFree(&r);
+  destroyContext(gc);
+}
+END_TEST
+
+START_TEST(test_frame_buffer_returns_latest_frame) {
+  static FrameBuffer_t fb;
+  frameBufferInit(&fb);
+  ck_assert_uint_eq(frameAcquire(&fb)->sequence, 0);
+
+  GameConfig_t config = {7, RANDOMIZER_BAG};
+  GameContext_t *gc = createContext(&config);
+  stepContext(gc, Start, false);
+  stepContext(gc, Up, false);
+  publishContext(gc, &fb);
+  const Frame_t *first = frameAcquire(&fb);
+  ck_assert_uint_eq(first->sequence, 1);
+  ck_assert_int_eq(first->state, STATE_FALLING);
+  ck_assert_int_eq(first->ghost_count, FIGURE_SIZE);
+  int y = gc->current.y + figureShape(&gc->current)->cells[0][0];
+  int x = gc->current.x + figureShape(&gc->current)->cells[0][1];
+  ck_assert_int_eq(first->field[y][x], gc->current.piece + 1);
+  ck_assert_ptr_eq(frameAcquire(&fb), first);
+
+  stepContext(gc, Left, false);
+  publishContext(gc, &fb);
+  stepContext(gc, Left, false);
+  publishContext(gc, &fb);
+  ck_assert_uint_eq(first->sequence, 1);
+  const Frame_t *latest = frameAcquire(&fb);
+  ck_assert_ptr_ne(latest, first);
+  ck_assert_uint_eq(latest->sequence, 3);
+  destroyContext(gc);
+}
+END_TEST
+
+static void *publishFrames(void *arg) {
+  FrameBuffer_t *fb = arg;
+  for (int i = 1; i <= 20000; i++) {
+    Frame_t *frame = frameBegin(fb);
+    memset(frame->field, i & 0xff, sizeof(frame->field));
+    frame->score = i;
+    framePublish(fb);
+  }
+  return NULL;
+}
+
+START_TEST(test_frame_buffer_concurrent_frames_are_whole) {
+  static FrameBuffer_t fb;
+  frameBufferInit(&fb);
+  pthread_t writer;
+  pthread_create(&writer, NULL, publishFrames, &fb);
+  uint64_t last = 0;
+  int torn = 0;
+  while (last < 20000) {
+    const Frame_t *frame = frameAcquire(&fb);
+    ck_assert_uint_ge(frame->sequence, last);
+    last = frame->sequence;
+    if (last) {
+      torn |= frame->score != (int)last;
+      for (int i = 0; i < FIELD_HEIGHT; i++) {
+        torn |= memcmp(frame->field[i], frame->field[0], FIELD_WIDTH) != 0;
+      }
+      torn |= frame->field[0][0] != (last & 0xff);
+    }
+  }
+  pthread_join(writer, NULL);
+  ck_assert_int_eq(torn, 0);
+}
+END_TEST
+
+START_TEST(test_ring_fifo_full_and_empty) {
+  static ActionRing_t ring;
+  ringInit(&ring);
+  ActionEvent_t event;
+  ck_assert(!ringPop(&ring, &event));
+  for (int round = 0; round < 3; round++) {
+    for (int i = 0; i < ACTION_RING_SIZE; i++) {
+      ActionEvent_t in = {(UserAction_t)(i % 8), i & 1, round * 1000 + i};
+      ck_assert(ringPush(&ring, &in));
+    }
+    ActionEvent_t extra = {Left, false, -1};
+    ck_assert(!ringPush(&ring, &extra));
+    for (int i = 0; i < ACTION_RING_SIZE; i++) {
+      ck_assert(ringPop(&ring, &event));
+      ck_assert_int_eq(event.action, i % 8);
+      ck_assert_int_eq(event.hold, i & 1);
+      ck_assert_int_eq(event.time_us, round * 1000 + i);
+    }
+    ck_assert(!ringPop(&ring, &event));
+  }
+}
+END_TEST
+
+static void *pushEvents(void *arg) {
+  ActionRing_t *ring = arg;
+  for (int64_t i = 1; i <= 100000; i++) {
+    ActionEvent_t event = {(UserAction_t)(i % 8), false, i};
+    while (!ringPush(ring, &event)) {
+    }
+  }
+  return NULL;
+}
+
+START_TEST(test_ring_concurrent_order_preserved) {
+  static ActionRing_t ring;
+  ringInit(&ring);
+  pthread_t producer;
+  pthread_create(&producer, NULL, pushEvents, &ring);
+  int64_t expected = 1;
+  int wrong = 0;
+  while (expected <= 100000) {
+    ActionEvent_t event;
+    if (ringPop(&ring, &event)) {
+      wrong |= event.time_us != expected;
+      wrong |= (int64_t)event.action != expected % 8;
+      expected++;
+    }
+  }
+  pthread_join(producer, NULL);
+  ck_assert_int_eq(wrong, 0);
+}
+END_TEST
+
+static GameContext_t *botTestContext(void) {
+  GameConfig_t config = {7, RANDOMIZER_BAG};
+  GameContext_t *gc = createContext(&config);
+  stepContext(gc, Start, false);
+  stepContext(gc, Up, false);
+  clearFigure(gc);
+  for (int x = 0; x < FIELD_WIDTH - 1; x++) {
+    for (int y = FIELD_HEIGHT - 1 - x % 3; y < FIELD_HEIGHT; y++) {
+      if ((x * 7 + y) % 5) setCell(gc, y, x, 3);
+    }
+  }
+  drawFigure(gc);
+  return gc;
+}
+
+static void botRecount(const BotBoard_t *b, int *aggregate, int *holes,
+                       int *bumpiness) {
+  int tops[FIELD_WIDTH];
+  *aggregate = *holes = *bumpiness = 0;
+  for (int x = 0; x < FIELD_WIDTH; x++) {
+    tops[x] = FIELD_HEIGHT;
+    for (int y = FIELD_HEIGHT - 1; y >= 0; y--) {
+      if (b->rows[y] >> x & 1) tops[x] = y;
+    }
+    for (int y = tops[x]; y < FIELD_HEIGHT; y++) {
+      *holes += !(b->rows[y] >> x & 1);
+    }
+    *aggregate += FIELD_HEIGHT - tops[x];
+    ck_assert_int_eq(b->heights[x], tops[x]);
+  }
+  for (int x = 0; x + 1 < FIELD_WIDTH; x++) {
+    *bumpiness += abs(tops[x] - tops[x + 1]);
+  }
+}
+
+START_TEST(test_bot_features_match_recount) {
+  GameContext_t *gc = botTestContext();
+  BotBoard_t board;
+  botBoardInit(&board, gc);
+  BotPlacement_t moves[BOT_MAX_PLACEMENTS];
+  int lines = 0;
+  for (int step = 0; step < 40; step++) {
+    Tetromino_t spawn = {(int8_t)(step % PIECE_COUNT), 0, SPAWN_X, SPAWN_Y};
+    int n = botPlacements(&board, &spawn, moves);
+    if (!n) break;
+    int before = board.lines;
+    botPlace(&board, &moves[(step * 5) % n].piece);
+    lines += board.lines - before;
+    int aggregate, holes, bumpiness;
+    botRecount(&board, &aggregate, &holes, &bumpiness);
+    ck_assert_int_eq(board.aggregate, aggregate);
+    ck_assert_int_eq(board.holes, holes);
+    ck_assert_int_eq(board.bumpiness, bumpiness);
+    int transitions = 0;
+    for (int y = 0; y < FIELD_HEIGHT; y++) {
+      for (int x = 0; x <= FIELD_WIDTH; x++) {
+        int left = x == 0 || (board.rows[y] >> (x - 1) & 1);
+        int here = x == FIELD_WIDTH || (board.rows[y] >> x & 1);
+        transitions += left != here;
+      }
+    }
+    ck_assert_int_eq(board.transitions, transitions);
+  }
+  ck_assert_int_eq(board.lines, lines);
+  destroyContext(gc);
+}
+END_TEST
+
+START_TEST(test_bot_steps_lock_piece_at_placement) {
+  GameContext_t *gc = botTestContext();
+  BotBoard_t board;
+  botBoardInit(&board, gc);
+  BotPlacement_t moves[BOT_MAX_PLACEMENTS];
+  int n = botPlacements(&board, &gc->current, moves);
+  ck_assert_int_gt(n, FIELD_WIDTH);
+  ContextSnapshot_t start;
+  saveSnapshot(gc, &start);
+  for (int i = 0; i < n; i++) {
+    UserAction_t steps[BOT_MAX_STEPS];
+    int count = botSteps(&board, &gc->current, &moves[i], steps);
+    ck_assert_int_gt(count, 0);
+    for (int k = 0; k < count; k++) stepContext(gc, steps[k], false);
+    ck_assert_int_ne(gc->state, STATE_FALLING);
+    const Tetromino_t *t = &moves[i].piece;
+    const PieceShape_t *s = figureShape(t);
+    for (int c = 0; c < FIGURE_SIZE; c++) {
+      int y = t->y + s->cells[c][0];
+      int x = t->x + s->cells[c][1];
+      ck_assert_int_eq(gc->cells[y][x], t->piece + 1);
+      ck_assert(!(board.rows[y] >> x & 1));
+    }
+    loadSnapshot(gc, &start);
+  }
+  destroyContext(gc);
+}
+END_TEST
+
+START_TEST(test_bot_takes_four_lines_with_i_piece) {
+  GameContext_t *gc = botTestContext();
+  clearFigure(gc);
+  for (int y = 0; y < FIELD_HEIGHT; y++) {
+    for (int x = 0; x < FIELD_WIDTH; x++) setCell(gc, y, x, 0);
+  }
+  for (int y = FIELD_HEIGHT - 4; y < FIELD_HEIGHT; y++) {
+    for (int x = 0; x < FIELD_WIDTH - 1; x++) setCell(gc, y, x, 2);
+  }
+  placePiece(gc, 0, 0, SPAWN_X, SPAWN_Y);
+  gc->next_piece = 3;
+  drawFigure(gc);
+
+  BotPlacement_t best;
+  ck_assert(botChoose(gc, &bot_default_weights, &best));
+  const PieceShape_t *s = figureShape(&best.piece);
+  for (int c = 0; c < FIGURE_SIZE; c++) {
+    ck_assert_int_eq(best.piece.x + s->cells[c][1], FIELD_WIDTH - 1);
+  }
+  BotBoard_t board;
+  botBoardInit(&board, gc);
+  botPlace(&board, &best.piece);
+  ck_assert_int_eq(board.lines, 4);
+  ck_assert_int_eq(board.aggregate, 0);
+  destroyContext(gc);
+}
+END_TEST
+
+START_TEST(test_bot_tucks_piece_under_overhang) {
+  GameContext_t *gc = botTestContext();
+  clearFigure(gc);
+  for (int y = 0; y < FIELD_HEIGHT; y++) {
+    for (int x = 0; x < FIELD_WIDTH; x++) {
+      setCell(gc, y, x, y == FIELD_HEIGHT - 3 && x >= 2 ? 2 : 0);
+    }
+  }
+  placePiece(gc, 1, 0, SPAWN_X, SPAWN_Y);
+  drawFigure(gc);
+
+  BotBoard_t board;
+  botBoardInit(&board, gc);
+  BotPlacement_t moves[BOT_MAX_PLACEMENTS];
+  int n = botPlacements(&board, &gc->current, moves);
+  int tuck = -1;
+  for (int i = 0; i < n; i++) {
+    const Tetromino_t *t = &moves[i].piece;
+    const PieceShape_t *s = figureShape(t);
+    if (t->x + s->left == FIELD_WIDTH - 2 &&
+        t->y + s->top == FIELD_HEIGHT - 2) {
+      tuck = i;
+    }
+    for (int j = 0; j < i; j++) {
+      const Tetromino_t *u = &moves[j].piece;
+      const PieceShape_t *z = figureShape(u);
+      ck_assert(s->mask != z->mask || t->x + s->left != u->x + z->left ||
+                t->y + s->top != u->y + z->top);
+    }
+  }
+  ck_assert_int_ge(tuck, 0);
+
+  UserAction_t steps[BOT_MAX_STEPS];
+  int count = botSteps(&board, &gc->current, &moves[tuck], steps);
+  ck_assert_int_gt(count, FIELD_WIDTH - 2);
+  for (int k = 0; k < count; k++) stepContext(gc, steps[k], false);
+  ck_assert_int_ne(gc->state, STATE_FALLING);
+  for (int y = FIELD_HEIGHT - 2; y < FIELD_HEIGHT; y++) {
+    ck_assert_int_eq(gc->cells[y][FIELD_WIDTH - 2], 2);
+    ck_assert_int_eq(gc->cells[y][FIELD_WIDTH - 1], 2);
+  }
+  destroyContext(gc);
+}
+END_TEST
+
+START_TEST(test_bot_play_is_reproducible) {
+  long lines[2], pieces[2];
+  uint64_t hash[2];
+  for (int run = 0; run < 2; run++) {
+    GameContext_t *gc = createContext(NULL);
+    seedContext(gc, 7, RANDOMIZER_UNIFORM);
+    long limit = 6 * FIELD_WIDTH;
+    pieces[run] = botPlay(gc, &bot_default_weights, limit);
+    ck_assert_int_le(pieces[run], limit);
+    ck_assert_int_gt(pieces[run], 0);
+    lines[run] = gc->lines;
+    hash[run] = gc->hash;
+    destroyContext(gc);
+  }
+#if FIELD_WIDTH <= 32
+  /* На очень широком поле веса по умолчанию строят лестницу к стенке, и
+     линий за это число фигур нет. */
+  ck_assert_int_gt(lines[0], 0);
+#endif
+  ck_assert_int_eq(lines[0], lines[1]);
+  ck_assert_int_eq(pieces[0], pieces[1]);
+  ck_assert_uint_eq(hash[0], hash[1]);
+}
+END_TEST
+
+START_TEST(test_pc_fills_gap_and_respects_sequence) {
+  GameContext_t *gc = botTestContext();
+  clearFigure(gc);
+  for (int y = 0; y < FIELD_HEIGHT; y++) {
+    for (int x = 0; x < FIELD_WIDTH; x++) {
+      setCell(gc, y, x, y >= FIELD_HEIGHT - 2 && x >= 4 ? 3 : 0);
+    }
+  }
+  placePiece(gc, 1, 0, SPAWN_X, SPAWN_Y);
+  drawFigure(gc);
+  BotBoard_t board;
+  botBoardInit(&board, gc);
+  PcSolver_t *solver = pcCreate(0);
+  BotPlacement_t plan[PC_MAX_PIECES];
+
+  const int8_t squares[] = {1, 1};
+  ck_assert_int_eq(pcSolve(solver, &board, &gc->current, squares, 2, plan), 2);
+  BotBoard_t after = board;
+  for (int i = 0; i < 2; i++) botPlace(&after, &plan[i].piece);
+  ck_assert_int_eq(after.lines, 2);
+  for (int x = 0; x < FIELD_WIDTH; x++) ck_assert_int_eq(after.filled[x], 0);
+  ck_assert_int_eq(pcSolve(solver, &board, &gc->current, squares, 1, plan), 0);
+  const int8_t tees[] = {1, 2};
+  ck_assert_int_eq(pcSolve(solver, &board, &gc->current, tees, 2, plan), 0);
+  pcDestroy(solver);
+  destroyContext(gc);
+}
+END_TEST
+
+/* Десять фигур складываются в четыре полные линии только при ширине 10. */
+#if FIELD_WIDTH == 10
+START_TEST(test_pc_plays_four_line_clear) {
+  GameConfig_t config = {1, RANDOMIZER_BAG};
+  GameContext_t *gc = createContext(&config);
+  stepContext(gc, Start, false);
+  while (gc->state != STATE_FALLING) stepContext(gc, Up, false);
+  PcSolver_t *solver = pcCreate(1);
+  BotPlacement_t plan[PC_MAX_PIECES];
+  ck_assert_int_eq(pcSolveGame(solver, gc, 10, plan), -1);
+  pcDestroy(solver);
+
+  solver = pcCreate(0);
+  int count = pcSolveGame(solver, gc, 10, plan);
+  ck_assert_int_eq(count, 10);
+  for (int i = 0; i < count; i++) {
+    while (gc->state != STATE_FALLING) stepContext(gc, Up, false);
+    BotBoard_t board;
+    botBoardInit(&board, gc);
+    UserAction_t steps[BOT_MAX_STEPS];
+    int n = botSteps(&board, &gc->current, &plan[i], steps);
+    ck_assert_int_gt(n, 0);
+    for (int k = 0; k < n; k++) stepContext(gc, steps[k], false);
+  }
+  while (gc->state != STATE_FALLING) stepContext(gc, Up, false);
+  ck_assert_int_eq(gc->lines, 4);
+  BotBoard_t board;
+  botBoardInit(&board, gc);
+  for (int x = 0; x < FIELD_WIDTH; x++) ck_assert_int_eq(board.filled[x], 0);
+  pcDestroy(solver);
+  destroyContext(gc);
+}
+END_TEST
+#endif
+
+START_TEST(test_batch_kernels_match_board) {
+  GameContext_t *gc = botTestContext();
+  BotBoard_t board;
+  botBoardInit(&board, gc);
+  BotWeights_t weights = bot_default_weights;
+  weights.transitions = -0.25f;
+  BatchIsa_t chosen = batchIsa();
+  BotPlacement_t moves[BOT_MAX_PLACEMENTS];
+  int checked = 0;
+  for (int step = 0; step < 30; step++) {
+    Tetromino_t spawn = {(int8_t)(step % PIECE_COUNT), 0, SPAWN_X, SPAWN_Y};
+    int n = botPlacements(&board, &spawn, moves);
+    if (!n) break;
+    for (int isa = BATCH_SCALAR; isa <= BATCH_AVX2; isa++) {
+      if (!batchSelect((BatchIsa_t)isa)) continue;
+      BotBatch_t batch;
+      batchFill(&batch, &board);
+      for (int i = 0; i < n; i += BATCH_LANES) {
+        int end = n - i < BATCH_LANES ? n : i + BATCH_LANES;
+        for (int j = i; j < end; j++) batchAdd(&batch, &moves[j].piece);
+        batchRun(&batch);
+        for (int lane = 0; lane < batch.count; lane++) {
+          BotBoard_t leaf = board;
+          botPlace(&leaf, &moves[i + lane].piece);
+          ck_assert_int_eq(batch.aggregate[lane], leaf.aggregate);
+          ck_assert_int_eq(batch.holes[lane], leaf.holes);
+          ck_assert_int_eq(batch.bumpiness[lane], leaf.bumpiness);
+          ck_assert_int_eq(batch.transitions[lane], leaf.transitions);
+          ck_assert_int_eq(batch.lines[lane], leaf.lines - board.lines);
+          ck_assert(batchScore(&batch, lane, &board, &weights) ==
+                    botEvaluate(&leaf, &weights));
+          checked++;
+        }
+        batchReset(&batch, &board);
+      }
+      for (int y = 0; y < FIELD_HEIGHT; y++) {
+        for (int lane = 0; lane < BATCH_LANES; lane++) {
+          ck_assert_uint_eq(batch.rows[y][lane], board.rows[y]);
+        }
+      }
+    }
+    botPlace(&board, &moves[(step * 7) % n].piece);
+  }
+  ck_assert(batchSelect(chosen));
+  ck_assert_int_gt(checked, 40 * FIELD_WIDTH);
+  destroyContext(gc);
+}
+END_TEST
+
+START_TEST(test_search_matches_bot_and_worker_count) {
+  GameContext_t *gc = botTestContext();
+  SearchPool_t *one = searchCreate(1);
+  SearchPool_t *four = searchCreate(4);
+  ck_assert_ptr_nonnull(one);
+  ck_assert_ptr_nonnull(four);
+  BotPlacement_t greedy, a, b;
+  SearchStats_t stats;
+  ck_assert(botChoose(gc, &bot_default_weights, &greedy));
+  ck_assert(searchChoose(four, gc, &bot_default_weights, 2, 0, &a, &stats));
+  ck_assert_int_eq(stats.depth, 2);
+  ck_assert_mem_eq(&a, &greedy, sizeof(a));
+
+  ck_assert(searchChoose(one, gc, &bot_default_weights, 3, 0, &a, &stats));
+  ck_assert_int_eq(stats.depth, 3);
+  ck_assert(searchChoose(four, gc, &bot_default_weights, 3, 0, &b, &stats));
+  ck_assert_mem_eq(&a, &b, sizeof(a));
+  searchDestroy(one);
+  searchDestroy(four);
+  destroyContext(gc);
+}
+END_TEST
+
+START_TEST(test_search_deadline_keeps_last_full_depth) {
+  GameContext_t *gc = botTestContext();
+  SearchPool_t *pool = searchCreate(2);
+  BotPlacement_t greedy, best;
+  SearchStats_t stats;
+  ck_assert(botChoose(gc, &bot_default_weights, &greedy));
+  ck_assert(searchChoose(pool, gc, &bot_default_weights, SEARCH_MAX_DEPTH, 1,
+                         &best, &stats));
+  ck_assert_int_eq(stats.depth, 2);
+  ck_assert_mem_eq(&best, &greedy, sizeof(best));
+
+  gc->state = STATE_PAUSED;
+  ck_assert(!searchChoose(pool, gc, &bot_default_weights, 3, 0, &best,
+                          &stats));
+  ck_assert_int_eq(stats.depth, 0);
+  searchDestroy(pool);
+  destroyContext(gc);
+}
+END_TEST
+
+START_TEST(test_search_table_reuses_subtrees) {
+  GameContext_t *gc = botTestContext();
+  SearchPool_t *pool = searchCreate(1);
+  BotPlacement_t a, b;
+  SearchStats_t first, second;
+  ck_assert(searchChoose(pool, gc, &bot_default_weights, 3, 0, &a, &first));
+  ck_assert(searchChoose(pool, gc, &bot_default_weights, 3, 0, &b, &second));
+  ck_assert_mem_eq(&a, &b, sizeof(a));
+  ck_assert_int_gt(second.hits, first.hits);
+  ck_assert_int_lt(second.nodes, first.nodes / 4);
+
+  BotWeights_t other = bot_default_weights;
+  other.holes *= 2;
+  ck_assert(searchChoose(pool, gc, &other, 3, 0, &b, &second));
+  ck_assert_int_eq(second.nodes, first.nodes);
+  searchDestroy(pool);
+  destroyContext(gc);
+}
+END_TEST
+
+/* Поиск на четыре фигуры по широкому полю слишком долог для тестов. */
+#if FIELD_WIDTH <= 16
+START_TEST(test_search_table_survives_line_clear) {
+  GameContext_t *gc = botTestContext();
+  clearFigure(gc);
+  for (int x = 0; x < FIELD_WIDTH - 1; x++) setCell(gc, FIELD_HEIGHT - 1, x, 3);
+  placePiece(gc, 0, 0, SPAWN_X, SPAWN_Y);
+  drawFigure(gc);
+  SearchPool_t *reused = searchCreate(1);
+  SearchPool_t *fresh = searchCreate(1);
+  BotPlacement_t a, b;
+  SearchStats_t stats;
+  ck_assert(searchChoose(reused, gc, &bot_default_weights, 4, 0, &a, &stats));
+
+  BotBoard_t board;
+  botBoardInit(&board, gc);
+  BotPlacement_t moves[BOT_MAX_PLACEMENTS];
+  int n = botPlacements(&board, &gc->current, moves);
+  int clear = -1;
+  for (int i = 0; i < n && clear < 0; i++) {
+    BotBoard_t after = board;
+    botPlace(&after, &moves[i].piece);
+    if (after.lines) clear = i;
+  }
+  ck_assert_int_ge(clear, 0);
+  UserAction_t steps[BOT_MAX_STEPS];
+  int count = botSteps(&board, &gc->current, &moves[clear], steps);
+  for (int k = 0; k < count; k++) stepContext(gc, steps[k], false);
+  while (gc->state != STATE_FALLING) stepContext(gc, Up, false);
+  ck_assert_int_eq(gc->lines, 1);
+
+  ck_assert(searchChoose(reused, gc, &bot_default_weights, 3, 0, &a, &stats));
+  ck_assert_int_gt(stats.hits, 0);
+  ck_assert(searchChoose(fresh, gc, &bot_default_weights, 3, 0, &b, NULL));
+  ck_assert_mem_eq(&a, &b, sizeof(a));
+  ck_assert_int_eq(reused->task_count, fresh->task_count);
+  for (int t = 0; t < fresh->task_count; t++) {
+    ck_assert(fabsf(reused->values[t] - fresh->values[t]) < 1e-3f);
+  }
+  searchDestroy(fresh);
+  searchDestroy(reused);
+  destroyContext(gc);
+}
+END_TEST
+#endif
+
+START_TEST(test_zobrist_hash_follows_board) {
+  GameContext_t *a = botTestContext();
+  GameContext_t *b = botTestContext();
+  ck_assert_uint_eq(a->hash, rowsKey(a->rows, 0, FIELD_HEIGHT));
+  ck_assert_uint_eq(contextHash(a), contextHash(b));
+  stepContext(a, Up, false);
+  stepContext(a, Action, false);
+  ck_assert_uint_ne(contextHash(a), contextHash(b));
+  stepContext(b, Action, false);
+  stepContext(b, Up, false);
+  ck_assert_uint_eq(contextHash(a), contextHash(b));
+
+  for (int i = 0; i < 60 && a->state != STATE_GAME_OVER; i++) {
+    BotPlacement_t best;
+    BotBoard_t board;
+    botBoardInit(&board, a);
+    UserAction_t steps[BOT_MAX_STEPS];
+    int count = botChoose(a, &bot_default_weights, &best)
+                    ? botSteps(&board, &a->current, &best, steps)
+                    : 0;
+    for (int k = 0; k < count; k++) {
+      stepContext(a, steps[k], false);
+      ck_assert_uint_eq(a->hash, rowsKey(a->rows, 0, FIELD_HEIGHT));
+    }
+    while (a->state == STATE_CLEARING || a->state == STATE_SPAWN) {
+      stepContext(a, Up, false);
+      ck_assert_uint_eq(a->hash, rowsKey(a->rows, 0, FIELD_HEIGHT));
+    }
+  }
+  ck_assert_int_gt(a->lines, 0);
+  destroyContext(a);
+  destroyContext(b);
+}
+END_TEST
+
 Suite *backend_suite() {
   Suite *s = suite_create("TetrisBackend");
   TCase *tc = tcase_create("Core");
   tcase_add_test(tc, test_getContext_singleton);
   tcase_add_test(tc, test_nextCurrentInit_copies_next_and_color);
+  tcase_add_test(tc, test_nextFigureInit_fills_preview);
   tcase_add_test(tc, test_clearLines_increment_score_and_compact);
+  tcase_add_test(tc, test_clearLines_multiple_keeps_partial_rows);
+  tcase_add_test(tc, test_full_rows_tracked_by_draw_and_clear);
+  tcase_add_test(tc, test_heights_and_landing_row);
+  tcase_add_test(tc, test_ghost_matches_hard_drop);
+#if FIELD_WIDTH >= 7
+  tcase_add_test(tc, test_auto_shift_das_and_arr);
+#endif
+#if FIELD_WIDTH >= 7
+  tcase_add_test(tc, test_auto_shift_instant_stops_at_obstacle);
+#endif
+  tcase_add_test(tc, test_pieceRow_matches_cells);
   tcase_add_test(tc, test_gameOver_writes_record_and_sets_pause);
   tcase_add_test(tc, test_checkCollision_empty_board_in_bounds);
   tcase_add_test(tc, test_checkCollision_out_of_bounds_right);
@@ -445,6 +1460,7 @@ Suite *backend_suite() {
   tcase_add_test(tc, test_fallingHandler_right_blocked_at_edge);
   tcase_add_test(tc, test_fallingHandler_down_locks_and_clearing);
   tcase_add_test(tc, test_fallingHandler_action_rotates_when_no_collision);
+  tcase_add_test(tc, test_fallingHandler_action_blocked_keeps_rotation);
   tcase_add_test(tc, test_fallingHandler_pause_sets_pause);
   tcase_add_test(tc, test_userInputHandler_start_to_spawn);
   tcase_add_test(tc, test_fallingHandler_terminate_sets_game_over);
@@ -456,6 +1472,36 @@ Suite *backend_suite() {
   tcase_add_test(tc, test_updateCurrentState_snapshot);
   tcase_add_test(tc, test_userInput_start_transition);
   tcase_add_test(tc, test_userInput_hold_ignored);
+  tcase_add_test(tc, test_createContext_instances_are_independent);
+  tcase_add_test(tc, test_createContext_uses_own_high_score_sink);
+  tcase_add_test(tc, test_initContext_expands_colors_at_query);
+  tcase_add_test(tc, test_rng_same_seed_same_sequence);
+  tcase_add_test(tc, test_queue_bag_contains_each_piece_once);
+  tcase_add_test(tc, test_seedContext_reproduces_piece_sequence);
+  tcase_add_test(tc, test_replay_roundtrip_and_verify);
+  tcase_add_test(tc, test_replay_load_rejects_corrupt_files);
+  tcase_add_test(tc, test_replay_seek_matches_full_playback);
+  tcase_add_test(tc, test_frame_buffer_returns_latest_frame);
+  tcase_add_test(tc, test_frame_buffer_concurrent_frames_are_whole);
+  tcase_add_test(tc, test_ring_fifo_full_and_empty);
+  tcase_add_test(tc, test_ring_concurrent_order_preserved);
+  tcase_add_test(tc, test_bot_features_match_recount);
+  tcase_add_test(tc, test_bot_steps_lock_piece_at_placement);
+  tcase_add_test(tc, test_bot_takes_four_lines_with_i_piece);
+  tcase_add_test(tc, test_bot_tucks_piece_under_overhang);
+  tcase_add_test(tc, test_bot_play_is_reproducible);
+  tcase_add_test(tc, test_batch_kernels_match_board);
+  tcase_add_test(tc, test_pc_fills_gap_and_respects_sequence);
+#if FIELD_WIDTH == 10
+  tcase_add_test(tc, test_pc_plays_four_line_clear);
+#endif
+  tcase_add_test(tc, test_search_matches_bot_and_worker_count);
+  tcase_add_test(tc, test_search_deadline_keeps_last_full_depth);
+  tcase_add_test(tc, test_search_table_reuses_subtrees);
+#if FIELD_WIDTH <= 16
+  tcase_add_test(tc, test_search_table_survives_line_clear);
+#endif
+  tcase_add_test(tc, test_zobrist_hash_follows_board);
   suite_add_tcase(s, tc);
   return s;
 }
@@ -0,0 +1,314 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../brick_game/tetris/backend.h"
+
+#define MAX_REPS 1001
+#define BOARD_VARIANTS 16
+#define PROBES 64
+
+/** Подготовленные данные бенчмарков. */
+typedef struct BenchState_t {
+  GameContext_t *gc;
+  ContextSnapshot_t boards[BOARD_VARIANTS];
+  ContextSnapshot_t cleared[FIGURE_SIZE + 1][BOARD_VARIANTS];
+  Tetromino_t probes[PROBES];
+  int lines;
+  double timer_overhead;
+  volatile long sink;
+} BenchState_t;
+
+typedef double (*BenchFn_t)(BenchState_t *st, long iterations);
+
+/** Описание одного бенчмарка. */
+typedef struct Bench_t {
+  const char *name;
+  BenchFn_t fn;
+  int lines;
+  int per_piece;
+} Bench_t;
+
+/** Результат: время одной операции по повторам. */
+typedef struct BenchResult_t {
+  double min, p50, p90, p99, max;
+} BenchResult_t;
+
+static double nowNs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+/**
+ * @brief Заполняет поле неровным рельефом с дырами: full_lines нижних строк
+ * заполнены целиком, остальные строки никогда не полные.
+ *
+ * @param gc         Указатель на контекст игры.
+ * @param rng        Генератор.
+ * @param full_lines Число полных строк снизу.
+ */
+static void randomBoard(GameContext_t *gc, Rng_t *rng, int full_lines) {
+  resetContext(gc);
+  int top = FIELD_HEIGHT - 4 - (int)rngBounded(rng, 8);
+  for (int y = top; y < FIELD_HEIGHT; y++) {
+    int full = y >= FIELD_HEIGHT - full_lines;
+    int gap = (int)rngBounded(rng, FIELD_WIDTH);
+    for (int x = 0; x < FIELD_WIDTH; x++) {
+      int filled = full || (x != gap && rngBounded(rng, 4) != 0);
+      setCell(gc, y, x, filled ? 1 + (int)rngBounded(rng, PIECE_COUNT) : 0);
+    }
+  }
+  gc->state = STATE_FALLING;
+}
+
+static double benchCheckCollision(BenchState_t *st, long iterations) {
+  double start = nowNs();
+  long hits = 0;
+  for (long i = 0; i < iterations; i++) {
+    st->gc->current = st->probes[i % PROBES];
+    hits += checkCollision(st->gc);
+  }
+  st->sink = hits;
+  return nowNs() - start;
+}
+
+static double benchCanFall(BenchState_t *st, long iterations) {
+  double start = nowNs();
+  long hits = 0;
+  for (long i = 0; i < iterations; i++) {
+    st->gc->current = st->probes[i % PROBES];
+    hits += canFall(st->gc);
+  }
+  st->sink = hits;
+  return nowNs() - start;
+}
+
+static double benchRotate(BenchState_t *st, long iterations) {
+  double start = nowNs();
+  for (long i = 0; i < iterations; i++) {
+    rotateTetromino(st->gc);
+  }
+  st->sink = st->gc->current.rotation;
+  return nowNs() - start;
+}
+
+static double benchDrop(BenchState_t *st, long iterations) {
+  double start = nowNs();
+  long depth = 0;
+  for (long i = 0; i < iterations; i++) {
+    st->gc->current = st->probes[i % PROBES];
+    if (checkCollision(st->gc)) {
+      dropTetromino(st->gc);
+      depth += st->gc->current.y;
+      clearFigure(st->gc);
+    }
+  }
+  st->sink = depth;
+  return nowNs() - start;
+}
+
+/**
+ * @brief Очистка линий на заранее подготовленных досках. Восстановление доски
+ * не входит в замер: каждая операция измеряется отдельно, из времени
+ * вычитаются накладные расходы таймера.
+ */
+static double benchClearLines(BenchState_t *st, long iterations) {
+  double total = 0;
+  for (long i = 0; i < iterations; i++) {
+    loadSnapshot(st->gc, &st->cleared[st->lines][i % BOARD_VARIANTS]);
+    double start = nowNs();
+    clearLines(st->gc);
+    total += nowNs() - start - st->timer_overhead;
+  }
+  st->sink = st->gc->lines;
+  return total > 0 ? total : 0;
+}
+
+/**
+ * @brief Полный цикл фигуры через автомат: появление, поворот, сдвиги на
+ * разное число клеток, сброс и очистка линий. При конце игры контекст
+ * сбрасывается.
+ */
+static double benchFsmCycle(BenchState_t *st, long iterations) {
+  double start = nowNs();
+  GameContext_t *gc = st->gc;
+  for (long i = 0; i < iterations; i++) {
+    if (gc->state == STATE_GAME_OVER) {
+      resetContext(gc);
+      inputHandler(gc, Start);
+    }
+    int shift = (int)(i % 9) - 4;
+    inputHandler(gc, Up);
+    inputHandler(gc, Action);
+    for (int m = 0; m < abs(shift); m++) {
+      inputHandler(gc, shift < 0 ? Left : Right);
+    }
+    inputHandler(gc, Down);
+    inputHandler(gc, Up);
+  }
+  st->sink = gc->info.score;
+  return nowNs() - start;
+}
+
+static int compareDoubles(const void *a, const void *b) {
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * @brief Прогревает и измеряет бенчмарк: reps повторов по iterations
+ * операций, время операции — перцентили по повторам.
+ */
+static BenchResult_t measure(BenchState_t *st, BenchFn_t fn, long iterations,
+                             int reps) {
+  static double samples[MAX_REPS];
+  fn(st, iterations);
+  for (int r = 0; r < reps; r++) {
+    samples[r] = fn(st, iterations) / (double)iterations;
+  }
+  qsort(samples, (size_t)reps, sizeof(double), compareDoubles);
+  BenchResult_t res = {samples[0], samples[reps / 2], samples[reps * 9 / 10],
+                       samples[reps * 99 / 100], samples[reps - 1]};
+  return res;
+}
+
+/**
+ * @brief Готовит доски: варианты рельефа и варианты с 0–4 полными строками,
+ * а также набор положений фигур для проверок коллизий.
+ */
+static void prepare(BenchState_t *st) {
+  Rng_t rng;
+  rngSeed(&rng, 12345);
+  for (int lines = 0; lines <= FIGURE_SIZE; lines++) {
+    for (int v = 0; v < BOARD_VARIANTS; v++) {
+      randomBoard(st->gc, &rng, lines);
+      saveSnapshot(st->gc, &st->cleared[lines][v]);
+    }
+  }
+  memcpy(st->boards, st->cleared[0], sizeof(st->boards));
+  for (int i = 0; i < PROBES; i++) {
+    Tetromino_t *t = &st->probes[i];
+    t->piece = (int8_t)rngBounded(&rng, PIECE_COUNT);
+    t->rotation = (int8_t)rngBounded(&rng, ROTATION_COUNT);
+    t->x = (int8_t)rngBounded(&rng, FIELD_WIDTH - 2);
+    t->y = (int8_t)rngBounded(&rng, 4);
+  }
+  loadSnapshot(st->gc, &st->boards[0]);
+  static double pairs[PROBES];
+  for (int i = 0; i < PROBES; i++) {
+    double start = nowNs();
+    pairs[i] = nowNs() - start;
+  }
+  qsort(pairs, PROBES, sizeof(double), compareDoubles);
+  st->timer_overhead = pairs[PROBES / 2];
+}
+
+/**
+ * @brief Пишет строку JSON в кавычках: кавычки, обратная косая черта и
+ * управляющие символы экранируются.
+ *
+ * @param out Файл.
+ * @param s   Строка.
+ */
+static void writeJsonString(FILE *out, const char *s) {
+  fputc('"', out);
+  for (; *s; s++) {
+    unsigned char c = (unsigned char)*s;
+    if (c == '"' || c == '\\') {
+      fprintf(out, "\\%c", c);
+    } else if (c < 0x20) {
+      fprintf(out, "\\u%04x", c);
+    } else {
+      fputc(c, out);
+    }
+  }
+  fputc('"', out);
+}
+
+/**
+ * @brief Точка входа: bench [-r повторов] [-i операций] [-o файл] [-l метка].
+ * Результаты печатаются таблицей и пишутся в JSON-файл.
+ */
+int main(int argc, char **argv) {
+  static const Bench_t benches[] = {
+      {"checkCollision", benchCheckCollision, 0, 0},
+      {"canFall", benchCanFall, 0, 0},
+      {"rotateTetromino", benchRotate, 0, 0},
+      {"dropTetromino", benchDrop, 0, 1},
+      {"clearLines_0", benchClearLines, 0, 1},
+      {"clearLines_1", benchClearLines, 1, 1},
+      {"clearLines_2", benchClearLines, 2, 1},
+      {"clearLines_3", benchClearLines, 3, 1},
+      {"clearLines_4", benchClearLines, 4, 1},
+      {"fsm_piece_cycle", benchFsmCycle, 0, 1},
+  };
+  int reps = 31;
+  long iterations = 100000;
+  const char *out_path = "bench.json";
+  const char *label = "";
+  int opt;
+  while ((opt = getopt(argc, argv, "r:i:o:l:")) != -1) {
+    if (opt == 'r') reps = atoi(optarg);
+    if (opt == 'i') iterations = atol(optarg);
+    if (opt == 'o') out_path = optarg;
+    if (opt == 'l') label = optarg;
+  }
+  if (reps < 1) reps = 1;
+  if (reps > MAX_REPS) reps = MAX_REPS;
+  if (iterations < 1) iterations = 1;
+
+  static BenchState_t st;
+  st.gc = createContext(NULL);
+  prepare(&st);
+  FILE *out = fopen(out_path, "w");
+  if (!out) {
+    fprintf(stderr, "cannot write %s\n", out_path);
+    return 1;
+  }
+  fprintf(out, "{\"label\": ");
+  writeJsonString(out, label);
+  fprintf(out, ", \"repetitions\": %d, \"iterations\": %ld, \"results\": [",
+          reps, iterations);
+  printf("%-18s %10s %10s %10s %10s %14s\n", "benchmark", "min ns", "p50 ns",
+         "p90 ns", "p99 ns", "pieces/sec");
+  int count = (int)(sizeof(benches) / sizeof(benches[0]));
+  for (int b = 0; b < count; b++) {
+    const Bench_t *bench = &benches[b];
+    st.lines = bench->lines;
+    loadSnapshot(st.gc, &st.boards[0]);
+    if (bench->fn == benchFsmCycle) {
+      /* Цикл автомата начинается с новой игры, а не со снимка поля. */
+      resetContext(st.gc);
+      inputHandler(st.gc, Start);
+    }
+    BenchResult_t res = measure(&st, bench->fn, iterations, reps);
+    double pieces = bench->per_piece && res.p50 > 0 ? 1e9 / res.p50 : 0;
+    printf("%-18s %10.2f %10.2f %10.2f %10.2f ", bench->name, res.min,
+           res.p50, res.p90, res.p99);
+    if (bench->per_piece) {
+      printf("%14.0f\n", pieces);
+    } else {
+      printf("%14s\n", "-");
+    }
+    fprintf(out,
+            "%s\n  {\"name\": \"%s\", \"ns_per_op\": {\"min\": %.3f, \"p50\":"
+            " %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f},"
+            " \"ops_per_sec\": %.0f, \"pieces_per_sec\": ",
+            b ? "," : "", bench->name, res.min, res.p50, res.p90, res.p99,
+            res.max, res.p50 > 0 ? 1e9 / res.p50 : 0);
+    if (bench->per_piece) {
+      fprintf(out, "%.0f}", pieces);
+    } else {
+      fprintf(out, "null}");
+    }
+  }
+  fprintf(out, "\n]}\n");
+  fclose(out);
+  destroyContext(st.gc);
+  return 0;
+}
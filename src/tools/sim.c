@@ -0,0 +1,366 @@
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../brick_game/tetris/backend.h"
+#include "../brick_game/tetris/batch.h"
+#include "../brick_game/tetris/bot.h"
+#include "../brick_game/tetris/replay.h"
+#include "../brick_game/tetris/search.h"
+
+#define MAX_SCRIPT 65536
+#define HISTOGRAM_BUCKETS 10
+
+/** Параметры запуска симуляции. */
+typedef struct SimConfig_t {
+  long games;
+  int threads;
+  uint64_t seed;
+  Randomizer_t randomizer;
+  long max_pieces;
+  const UserAction_t *script;
+  int script_len;
+  const char *record_path;
+  uint32_t keyframe_interval;
+  int depth;
+  int search_workers;
+  long budget_us;
+} SimConfig_t;
+
+/**
+ * Общее состояние воркеров: счётчик выданных игр и результаты. failed
+ * поднимает воркер, которому не хватило памяти на контекст или пул
+ * перебора.
+ */
+typedef struct SimShared_t {
+  const SimConfig_t *config;
+  atomic_long next_game;
+  atomic_long pieces;
+  atomic_long lines;
+  atomic_long moves;
+  atomic_long nodes;
+  atomic_long hits;
+  atomic_long depths;
+  atomic_bool failed;
+  int *scores;
+} SimShared_t;
+
+/**
+ * План бота для текущей фигуры: действия до посадки. search — пул
+ * перебора вглубь (NULL — botChoose()), moves, nodes, hits и depths —
+ * число выборов, узлов, попаданий в таблицу транспозиций и сумма
+ * достигнутых глубин перебора.
+ */
+typedef struct Plan_t {
+  UserAction_t steps[BOT_MAX_STEPS];
+  int count;
+  int pos;
+  SearchPool_t *search;
+  long moves, nodes, hits, depths;
+} Plan_t;
+
+/**
+ * @brief Выбирает посадку текущей фигуры и раскладывает её в действия.
+ *
+ * @param gc     Указатель на контекст игры (STATE_FALLING).
+ * @param config Параметры симуляции: глубина и срок перебора.
+ * @param plan   План.
+ */
+static void planMove(const GameContext_t *gc, const SimConfig_t *config,
+                     Plan_t *plan) {
+  BotPlacement_t best;
+  SearchStats_t stats = {2, 0, 0};
+  int found = plan->search
+                  ? searchChoose(plan->search, gc, &bot_default_weights,
+                                 config->depth, config->budget_us, &best,
+                                 &stats)
+                  : botChoose(gc, &bot_default_weights, &best);
+  BotBoard_t board;
+  botBoardInit(&board, gc);
+  plan->pos = 0;
+  plan->count = found ? botSteps(&board, &gc->current, &best, plan->steps) : 0;
+  plan->moves++;
+  plan->nodes += stats.nodes;
+  plan->hits += stats.hits;
+  plan->depths += stats.depth;
+}
+
+/**
+ * @brief Проигрывает одну игру до конца, лимита фигур или конца сценария.
+ *
+ * @param gc     Указатель на контекст игры.
+ * @param config Параметры симуляции.
+ * @param plan   План бота.
+ * @param pieces Счётчик заспавненных фигур.
+ */
+static void playGame(GameContext_t *gc, const SimConfig_t *config,
+                     Plan_t *plan, long *pieces) {
+  int pos = 0;
+  plan->count = 0;
+  stepContext(gc, Start, false);
+  while (gc->state != STATE_GAME_OVER && *pieces < config->max_pieces &&
+         (!config->script || pos < config->script_len)) {
+    TetrisState_t before = gc->state;
+    UserAction_t action = Up;
+    if (config->script) {
+      action = config->script[pos++];
+    } else if (gc->state == STATE_FALLING) {
+      action = plan->pos < plan->count ? plan->steps[plan->pos++] : Down;
+    }
+    stepContext(gc, action, false);
+    if (before == STATE_SPAWN && gc->state == STATE_FALLING) {
+      (*pieces)++;
+      if (!config->script) planMove(gc, config, plan);
+    }
+  }
+}
+
+/**
+ * @brief Поток-воркер: берёт номера игр из общего счётчика и проигрывает их
+ * на собственном контексте. Зерно игры зависит только от её номера.
+ *
+ * Без контекста или пула перебора воркер не играет и поднимает failed.
+ *
+ * @param arg Указатель на SimShared_t.
+ * @return NULL.
+ */
+static void *worker(void *arg) {
+  SimShared_t *shared = arg;
+  const SimConfig_t *config = shared->config;
+  GameContext_t *gc = createContext(NULL);
+  Plan_t plan = {.search = NULL, .moves = 0, .nodes = 0, .hits = 0,
+                 .depths = 0};
+  if (config->depth > 2 || config->search_workers > 1) {
+    plan.search = searchCreate(config->search_workers);
+    if (!plan.search) {
+      destroyContext(gc);
+      gc = NULL;
+    }
+  }
+  if (!gc) atomic_store(&shared->failed, true);
+  long game;
+  while (gc && (game = atomic_fetch_add(&shared->next_game, 1)) <
+                   config->games) {
+    uint64_t seed = config->seed + (uint64_t)game;
+    Replay_t replay;
+    int record = game == 0 && config->record_path;
+    if (record) {
+      replayStart(&replay, gc, seed, config->randomizer,
+                  config->keyframe_interval);
+    } else {
+      seedContext(gc, seed, config->randomizer);
+    }
+    long pieces = 0;
+    playGame(gc, config, &plan, &pieces);
+    if (record) {
+      replayFinish(&replay, gc);
+      if (!replaySave(&replay, config->record_path)) {
+        fprintf(stderr, "cannot write %s\n", config->record_path);
+      }
+      replayFree(&replay);
+    }
+    shared->scores[game] = gc->info.score;
+    atomic_fetch_add(&shared->pieces, pieces);
+    atomic_fetch_add(&shared->lines, gc->lines);
+  }
+  atomic_fetch_add(&shared->moves, plan.moves);
+  atomic_fetch_add(&shared->nodes, plan.nodes);
+  atomic_fetch_add(&shared->hits, plan.hits);
+  atomic_fetch_add(&shared->depths, plan.depths);
+  searchDestroy(plan.search);
+  destroyContext(gc);
+  return NULL;
+}
+
+static int compareInts(const void *a, const void *b) {
+  int x = *(const int *)a;
+  int y = *(const int *)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * @brief Печатает производительность и распределение очков.
+ *
+ * @param shared  Результаты симуляции.
+ * @param seconds Затраченное время.
+ */
+static void report(SimShared_t *shared, double seconds) {
+  const SimConfig_t *config = shared->config;
+  long n = config->games;
+  long pieces = atomic_load(&shared->pieces);
+  qsort(shared->scores, (size_t)n, sizeof(int), compareInts);
+  double mean = 0;
+  for (long i = 0; i < n; i++) mean += shared->scores[i];
+  mean /= (double)n;
+  printf("games:       %ld (%d threads)\n", n, config->threads);
+  printf("pieces:      %ld\n", pieces);
+  printf("lines:       %ld\n", atomic_load(&shared->lines));
+  printf("time:        %.3f s\n", seconds);
+  printf("games/sec:   %.1f\n", (double)n / seconds);
+  printf("pieces/sec:  %.1f\n", (double)pieces / seconds);
+  static const char *const isa_names[] = {"scalar", "sse4.1", "avx2"};
+  printf("eval:        %s\n", isa_names[batchIsa()]);
+  long moves = atomic_load(&shared->moves);
+  if (config->depth > 2 && moves) {
+    printf("search:      depth %.2f, %.0f nodes/move, %.0f nodes/sec\n",
+           (double)atomic_load(&shared->depths) / (double)moves,
+           (double)atomic_load(&shared->nodes) / (double)moves,
+           (double)atomic_load(&shared->nodes) / seconds);
+    printf("table hits:  %.0f/move\n",
+           (double)atomic_load(&shared->hits) / (double)moves);
+  }
+  printf("score mean:  %.1f\n", mean);
+  printf("score min/p50/p90/p99/max: %d/%d/%d/%d/%d\n", shared->scores[0],
+         shared->scores[n / 2], shared->scores[n * 9 / 10],
+         shared->scores[n * 99 / 100], shared->scores[n - 1]);
+  int lo = shared->scores[0];
+  int width = (shared->scores[n - 1] - lo) / HISTOGRAM_BUCKETS + 1;
+  long buckets[HISTOGRAM_BUCKETS] = {0};
+  for (long i = 0; i < n; i++) buckets[(shared->scores[i] - lo) / width]++;
+  for (int b = 0; b < HISTOGRAM_BUCKETS; b++) {
+    printf("  [%7d, %7d) %ld\n", lo + b * width, lo + (b + 1) * width,
+           buckets[b]);
+  }
+}
+
+/**
+ * @brief Читает сценарий ввода: по одному символу на действие (S — Start,
+ * P — Pause, T — Terminate, L/R — влево/вправо, U — шаг гравитации,
+ * D — сброс, A — поворот), остальные символы пропускаются.
+ *
+ * @param path   Путь к файлу сценария.
+ * @param script Буфер действий.
+ * @return Число прочитанных действий или -1 при ошибке.
+ */
+static int loadScript(const char *path, UserAction_t *script) {
+  FILE *f = fopen(path, "r");
+  int len = -1;
+  if (f) {
+    len = 0;
+    int ch;
+    while ((ch = fgetc(f)) != EOF && len < MAX_SCRIPT) {
+      const char *keys = "SPTLRUDA";
+      const char *k = strchr(keys, ch);
+      if (ch && k) script[len++] = (UserAction_t)(k - keys);
+    }
+    fclose(f);
+  }
+  return len;
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/**
+ * @brief Переигрывает сохранённую запись без фронтенда и проверяет итог.
+ *
+ * @param path Путь к файлу записи.
+ * @return Код выхода: 0 — итог совпал, 1 — ошибка или расхождение.
+ */
+static int playback(const char *path) {
+  Replay_t replay;
+  int code = 1;
+  if (!replayLoad(&replay, path)) {
+    fprintf(stderr, "cannot read replay %s\n", path);
+  } else {
+    double start = now();
+    int ok = replayVerify(&replay);
+    double seconds = now() - start;
+    printf("events:      %u (%zu bytes)\n", replay.event_count, replay.size);
+    printf("pieces:      %u, keyframes: %u\n", replay.pieces,
+           replay.keyframe_count);
+    printf("score:       %d, lines: %d\n", replay.final_score,
+           replay.final_lines);
+    printf("replayed in  %.6f s (%.0f events/sec)\n", seconds,
+           (double)replay.event_count / seconds);
+    printf("%s\n", ok ? "verified" : "DIVERGED");
+    replayFree(&replay);
+    code = !ok;
+  }
+  return code;
+}
+
+/**
+ * @brief Точка входа: sim [-n игр] [-j потоков] [-s зерно] [-b] [-m фигур]
+ * [-f сценарий] [-r запись [-k интервал кадров]] | sim -p запись.
+ */
+int main(int argc, char **argv) {
+  static UserAction_t script[MAX_SCRIPT];
+  SimConfig_t config = {1000, (int)sysconf(_SC_NPROCESSORS_ONLN), 1,
+                        RANDOMIZER_UNIFORM, 100000, NULL, 0, NULL, 50,
+                        2, 1, 0};
+  const char *playback_path = NULL;
+  int opt;
+  int ok = 1;
+  while (ok && (opt = getopt(argc, argv, "n:j:s:bm:f:r:k:p:d:w:t:")) != -1) {
+    if (opt == 'n') {
+      config.games = atol(optarg);
+    } else if (opt == 'j') {
+      config.threads = atoi(optarg);
+    } else if (opt == 's') {
+      config.seed = strtoull(optarg, NULL, 10);
+    } else if (opt == 'b') {
+      config.randomizer = RANDOMIZER_BAG;
+    } else if (opt == 'm') {
+      config.max_pieces = atol(optarg);
+    } else if (opt == 'f') {
+      config.script_len = loadScript(optarg, script);
+      config.script = script;
+      ok = config.script_len >= 0;
+    } else if (opt == 'r') {
+      config.record_path = optarg;
+    } else if (opt == 'k') {
+      config.keyframe_interval = (uint32_t)atoi(optarg);
+    } else if (opt == 'p') {
+      playback_path = optarg;
+    } else if (opt == 'd') {
+      config.depth = atoi(optarg);
+    } else if (opt == 'w') {
+      config.search_workers = atoi(optarg);
+    } else if (opt == 't') {
+      config.budget_us = atol(optarg) * 1000;
+    } else {
+      ok = 0;
+    }
+  }
+  if (config.threads < 1) config.threads = 1;
+  if (!ok || config.games < 1) {
+    fprintf(stderr,
+            "usage: %s [-n games] [-j threads] [-s seed] [-b] [-m max_pieces]"
+            " [-f script] [-r replay [-k keyframe_interval]]"
+            " [-d depth] [-w search_workers] [-t budget_ms] | -p replay\n",
+            argv[0]);
+    return 1;
+  }
+  if (playback_path) return playback(playback_path);
+
+  SimShared_t shared = {&config, 0, 0, 0, 0, 0, 0, 0, false,
+                        calloc((size_t)config.games, sizeof(int))};
+  pthread_t *threads = malloc((size_t)config.threads * sizeof(pthread_t));
+  double start = now();
+  int started = 0;
+  ok = shared.scores != NULL && threads != NULL;
+  while (ok && started < config.threads) {
+    ok = pthread_create(&threads[started], NULL, worker, &shared) == 0;
+    started += ok;
+  }
+  for (int i = 0; i < started; i++) pthread_join(threads[i], NULL);
+  ok = ok && !atomic_load(&shared.failed);
+  if (ok) {
+    report(&shared, now() - start);
+  } else {
+    fprintf(stderr, "simulation failed: out of memory or threads\n");
+  }
+  free(threads);
+  free(shared.scores);
+  return !ok;
+}
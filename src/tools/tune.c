@@ -0,0 +1,466 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../brick_game/tetris/backend.h"
+#include "../brick_game/tetris/bot.h"
+
+/** Число весов в BotWeights_t: генетический поиск работает с ними как с
+ * вектором. */
+#define TUNE_DIM ((int)(sizeof(BotWeights_t) / sizeof(float)))
+#define TUNE_MAX_POPULATION 1024
+/** Лучшие особи переходят в следующее поколение без изменений. */
+#define TUNE_ELITE 2
+#define TUNE_TOURNAMENT 3
+#define TUNE_MUTATION_RATE 0.2
+#define TUNE_MUTATION_SIGMA 0.2
+#define TUNE_CHECKPOINT_VERSION 1
+#define TUNE_PI 3.14159265358979323846
+
+_Static_assert(sizeof(BotWeights_t) == TUNE_DIM * sizeof(float),
+               "BotWeights_t must be a plain vector of floats");
+
+/**
+ * Параметры подбора. Всё, кроме generations и threads, сохраняется в
+ * контрольной точке и при продолжении берётся из неё.
+ */
+typedef struct TuneConfig_t {
+  int population;
+  int generations;
+  long games;
+  long max_pieces;
+  uint64_t seed;
+  Randomizer_t randomizer;
+  int threads;
+  const char *checkpoint;
+} TuneConfig_t;
+
+/**
+ * Состояние подбора между поколениями: номер поколения, генератор отбора
+ * и скрещивания и популяция весов. Этого достаточно, чтобы продолжить
+ * подбор с того же места и получить тот же результат.
+ */
+typedef struct TuneState_t {
+  int generation;
+  Rng_t rng;
+  BotWeights_t population[TUNE_MAX_POPULATION];
+} TuneState_t;
+
+/**
+ * Задание воркерам на одно поколение: все пары (особь, игра) по общему
+ * счётчику; lines[i * games + g] — линии особи i в игре g. failed
+ * поднимает воркер, которому не хватило памяти на контекст.
+ */
+typedef struct TuneJobs_t {
+  const TuneConfig_t *config;
+  const BotWeights_t *population;
+  uint64_t first_seed;
+  atomic_long next;
+  atomic_bool failed;
+  long *lines;
+} TuneJobs_t;
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/**
+ * @brief Нормирует вектор весов к единичной длине: оценка линейна, и
+ * пропорциональные веса выбирают одни и те же посадки.
+ *
+ * @param v Вектор из TUNE_DIM чисел.
+ */
+static void normalize(float *v) {
+  double norm = 0;
+  for (int i = 0; i < TUNE_DIM; i++) norm += (double)v[i] * v[i];
+  norm = sqrt(norm);
+  for (int i = 0; i < TUNE_DIM && norm > 0; i++) v[i] = (float)(v[i] / norm);
+}
+
+/**
+ * @brief Возвращает равномерное число из [0, 1).
+ *
+ * @param rng Генератор.
+ * @return Число.
+ */
+static double uniform(Rng_t *rng) {
+  return (double)(rngNext(rng) >> 11) * 0x1.0p-53;
+}
+
+/**
+ * @brief Возвращает нормальное число N(0, 1) (преобразование Бокса —
+ * Мюллера).
+ *
+ * @param rng Генератор.
+ * @return Число.
+ */
+static double gaussian(Rng_t *rng) {
+  double u = 1.0 - uniform(rng);
+  double v = uniform(rng);
+  return sqrt(-2.0 * log(u)) * cos(2.0 * TUNE_PI * v);
+}
+
+/**
+ * @brief Поток-воркер: берёт пары (особь, игра) из общего счётчика и играет
+ * их на собственном контексте. Игра g поколения идёт с зерном
+ * first_seed + g у всех особей, так что особи сравниваются на одних и тех
+ * же последовательностях фигур.
+ *
+ * @param arg Указатель на TuneJobs_t.
+ * @return NULL.
+ */
+static void *worker(void *arg) {
+  TuneJobs_t *jobs = arg;
+  const TuneConfig_t *config = jobs->config;
+  long total = config->population * config->games;
+  GameContext_t *gc = createContext(NULL);
+  long job;
+  if (!gc) atomic_store(&jobs->failed, true);
+  while (gc && (job = atomic_fetch_add(&jobs->next, 1)) < total) {
+    long game = job % config->games;
+    seedContext(gc, jobs->first_seed + (uint64_t)game, config->randomizer);
+    botPlay(gc, &jobs->population[job / config->games], config->max_pieces);
+    jobs->lines[job] = gc->lines;
+  }
+  destroyContext(gc);
+  return NULL;
+}
+
+/**
+ * @brief Играет поколение: каждая особь — config->games игр на общем
+ * наборе зёрен поколения.
+ *
+ * @param      config  Параметры подбора.
+ * @param      state   Состояние с популяцией.
+ * @param[out] fitness Средние линии за игру для каждой особи.
+ * @return 1 при успехе; 0 — не хватило памяти или не запустился поток,
+ * fitness тогда не заполнена.
+ */
+static int evaluate(const TuneConfig_t *config, const TuneState_t *state,
+                    double *fitness) {
+  long total = config->population * config->games;
+  TuneJobs_t jobs = {config, state->population,
+                     config->seed + (uint64_t)state->generation *
+                                        (uint64_t)config->games,
+                     0, false, calloc((size_t)total, sizeof(long))};
+  pthread_t *threads = malloc((size_t)config->threads * sizeof(pthread_t));
+  int started = 0;
+  int ok = jobs.lines != NULL && threads != NULL;
+  while (ok && started < config->threads) {
+    ok = pthread_create(&threads[started], NULL, worker, &jobs) == 0;
+    started += ok;
+  }
+  for (int i = 0; i < started; i++) pthread_join(threads[i], NULL);
+  ok = ok && !atomic_load(&jobs.failed);
+  for (int i = 0; ok && i < config->population; i++) {
+    long sum = 0;
+    for (long g = 0; g < config->games; g++) {
+      sum += jobs.lines[i * config->games + g];
+    }
+    fitness[i] = (double)sum / (double)config->games;
+  }
+  free(threads);
+  free(jobs.lines);
+  return ok;
+}
+
+/**
+ * @brief Выбирает особь турниром: лучшая из TUNE_TOURNAMENT случайных.
+ *
+ * @param config  Параметры подбора.
+ * @param rng     Генератор.
+ * @param fitness Приспособленность особей.
+ * @return Индекс особи.
+ */
+static int tournament(const TuneConfig_t *config, Rng_t *rng,
+                      const double *fitness) {
+  int best = (int)rngBounded(rng, (uint32_t)config->population);
+  for (int i = 1; i < TUNE_TOURNAMENT; i++) {
+    int other = (int)rngBounded(rng, (uint32_t)config->population);
+    if (fitness[other] > fitness[best]) best = other;
+  }
+  return best;
+}
+
+/**
+ * @brief Строит следующее поколение. TUNE_ELITE лучших особей переходят без
+ * изменений; остальные — потомки двух родителей, выбранных турниром:
+ * среднее родителей с весами по их приспособленности, с вероятностью
+ * TUNE_MUTATION_RATE один вес сдвигается на N(0, TUNE_MUTATION_SIGMA).
+ * Потомок нормируется.
+ *
+ * @param config  Параметры подбора.
+ * @param state   Состояние; популяция заменяется следующим поколением.
+ * @param fitness Приспособленность текущего поколения.
+ * @param order   Индексы особей по убыванию приспособленности.
+ */
+static void breed(const TuneConfig_t *config, TuneState_t *state,
+                  const double *fitness, const int *order) {
+  static BotWeights_t next[TUNE_MAX_POPULATION];
+  int elite = config->population < TUNE_ELITE ? config->population
+                                              : TUNE_ELITE;
+  for (int i = 0; i < elite; i++) next[i] = state->population[order[i]];
+  for (int i = elite; i < config->population; i++) {
+    int a = tournament(config, &state->rng, fitness);
+    int b = tournament(config, &state->rng, fitness);
+    double fa = fitness[a] + 1e-9, fb = fitness[b] + 1e-9;
+    float pa[TUNE_DIM], pb[TUNE_DIM], child[TUNE_DIM];
+    memcpy(pa, &state->population[a], sizeof(pa));
+    memcpy(pb, &state->population[b], sizeof(pb));
+    for (int k = 0; k < TUNE_DIM; k++) {
+      child[k] = (float)((fa * pa[k] + fb * pb[k]) / (fa + fb));
+    }
+    if (uniform(&state->rng) < TUNE_MUTATION_RATE) {
+      int k = (int)rngBounded(&state->rng, TUNE_DIM);
+      child[k] += (float)(TUNE_MUTATION_SIGMA * gaussian(&state->rng));
+    }
+    normalize(child);
+    memcpy(&next[i], child, sizeof(child));
+  }
+  memcpy(state->population, next,
+         (size_t)config->population * sizeof(BotWeights_t));
+}
+
+/**
+ * @brief Создаёт нулевое поколение: веса по умолчанию и случайные векторы
+ * из [-1, 1]^TUNE_DIM, все нормированные.
+ *
+ * @param config Параметры подбора.
+ * @param state  Состояние.
+ */
+static void seedPopulation(const TuneConfig_t *config, TuneState_t *state) {
+  state->generation = 0;
+  rngSeed(&state->rng, config->seed);
+  for (int i = 0; i < config->population; i++) {
+    float v[TUNE_DIM];
+    memcpy(v, &bot_default_weights, sizeof(v));
+    for (int k = 0; i > 0 && k < TUNE_DIM; k++) {
+      v[k] = (float)(2.0 * uniform(&state->rng) - 1.0);
+    }
+    normalize(v);
+    memcpy(&state->population[i], v, sizeof(v));
+  }
+}
+
+/**
+ * @brief Записывает контрольную точку: параметры подбора, номер поколения,
+ * состояние генератора и популяцию (веса — шестнадцатеричные float, без
+ * потери точности). Файл пишется рядом и переименовывается, поэтому
+ * прерванная запись не портит прошлую точку.
+ *
+ * @param config Параметры подбора.
+ * @param state  Состояние.
+ * @return 1 при успехе.
+ */
+static int saveCheckpoint(const TuneConfig_t *config,
+                          const TuneState_t *state) {
+  char tmp[4096];
+  snprintf(tmp, sizeof(tmp), "%s.tmp", config->checkpoint);
+  FILE *f = fopen(tmp, "w");
+  int ok = f != NULL;
+  if (ok) {
+    fprintf(f, "tune %d %d\n", TUNE_CHECKPOINT_VERSION, TUNE_DIM);
+    fprintf(f, "%d %ld %ld %llu %d\n", config->population, config->games,
+            config->max_pieces, (unsigned long long)config->seed,
+            (int)config->randomizer);
+    fprintf(f, "%d\n", state->generation);
+    for (int i = 0; i < 4; i++) {
+      fprintf(f, "%llu%c", (unsigned long long)state->rng.s[i],
+              i == 3 ? '\n' : ' ');
+    }
+    for (int i = 0; i < config->population; i++) {
+      float v[TUNE_DIM];
+      memcpy(v, &state->population[i], sizeof(v));
+      for (int k = 0; k < TUNE_DIM; k++) {
+        fprintf(f, "%a%c", (double)v[k], k == TUNE_DIM - 1 ? '\n' : ' ');
+      }
+    }
+    ok = !ferror(f);
+    ok &= fclose(f) == 0;
+    ok = ok && rename(tmp, config->checkpoint) == 0;
+  }
+  return ok;
+}
+
+/**
+ * @brief Читает контрольную точку, записанную saveCheckpoint(), и берёт из
+ * неё параметры подбора.
+ *
+ * @param config Параметры подбора (generations и threads не меняются).
+ * @param state  Состояние.
+ * @return 1, если точка прочитана; 0 — файла нет; -1 — файл не открылся,
+ * повреждён или не той версии.
+ */
+static int loadCheckpoint(TuneConfig_t *config, TuneState_t *state) {
+  FILE *f = fopen(config->checkpoint, "r");
+  if (!f) return errno == ENOENT ? 0 : -1;
+  int version = 0, dim = 0, randomizer = 0;
+  unsigned long long seed = 0, s[4] = {0, 0, 0, 0};
+  TuneConfig_t loaded = *config;
+  int ok = fscanf(f, "tune %d %d", &version, &dim) == 2 &&
+           version == TUNE_CHECKPOINT_VERSION && dim == TUNE_DIM;
+  ok = ok && fscanf(f, "%d %ld %ld %llu %d", &loaded.population,
+                    &loaded.games, &loaded.max_pieces, &seed,
+                    &randomizer) == 5;
+  ok = ok && loaded.population > 0 &&
+       loaded.population <= TUNE_MAX_POPULATION && loaded.games > 0 &&
+       loaded.max_pieces > 0 && randomizer >= RANDOMIZER_UNIFORM &&
+       randomizer <= RANDOMIZER_BAG;
+  ok = ok && fscanf(f, "%d", &state->generation) == 1 &&
+       state->generation >= 0;
+  ok = ok && fscanf(f, "%llu %llu %llu %llu", &s[0], &s[1], &s[2],
+                    &s[3]) == 4;
+  for (int i = 0; ok && i < loaded.population; i++) {
+    float v[TUNE_DIM];
+    for (int k = 0; ok && k < TUNE_DIM; k++) {
+      double x;
+      ok = fscanf(f, "%la", &x) == 1;
+      v[k] = (float)x;
+    }
+    memcpy(&state->population[i], v, sizeof(v));
+  }
+  fclose(f);
+  if (ok) {
+    loaded.seed = seed;
+    loaded.randomizer = (Randomizer_t)randomizer;
+    for (int i = 0; i < 4; i++) state->rng.s[i] = s[i];
+    *config = loaded;
+  }
+  return ok ? 1 : -1;
+}
+
+/**
+ * @brief Упорядочивает особи по убыванию приспособленности; при равенстве
+ * — по индексу, чтобы порядок не зависел от числа потоков и сортировки.
+ *
+ * @param      count   Число особей.
+ * @param      fitness Приспособленность.
+ * @param[out] order   Индексы особей.
+ */
+static void rank(int count, const double *fitness, int *order) {
+  for (int i = 0; i < count; i++) {
+    int j = i;
+    while (j > 0 && fitness[order[j - 1]] < fitness[i]) {
+      order[j] = order[j - 1];
+      j--;
+    }
+    order[j] = i;
+  }
+}
+
+/**
+ * @brief Печатает сводку поколения: лучшая, средняя, медианная и худшая
+ * приспособленность, стандартное отклонение, время и веса лучшей особи.
+ *
+ * @param config  Параметры подбора.
+ * @param state   Состояние (популяция оценённого поколения).
+ * @param fitness Приспособленность.
+ * @param order   Индексы особей по убыванию приспособленности.
+ * @param seconds Время поколения.
+ */
+static void report(const TuneConfig_t *config, const TuneState_t *state,
+                   const double *fitness, const int *order, double seconds) {
+  int n = config->population;
+  double mean = 0, var = 0;
+  for (int i = 0; i < n; i++) mean += fitness[i];
+  mean /= n;
+  for (int i = 0; i < n; i++) var += (fitness[i] - mean) * (fitness[i] - mean);
+  double median = n % 2 ? fitness[order[n / 2]]
+                        : (fitness[order[n / 2 - 1]] + fitness[order[n / 2]]) /
+                              2;
+  const BotWeights_t *w = &state->population[order[0]];
+  printf("gen %4d  best %9.1f  mean %9.1f  median %9.1f  worst %9.1f"
+         "  sd %8.1f  %.2f s\n",
+         state->generation, fitness[order[0]], mean, median,
+         fitness[order[n - 1]], sqrt(var / n), seconds);
+  printf("          holes %.6f height %.6f bumpiness %.6f lines %.6f"
+         " transitions %.6f\n",
+         w->holes, w->height, w->bumpiness, w->lines, w->transitions);
+  fflush(stdout);
+}
+
+/**
+ * @brief Точка входа: tune [-p особей] [-g поколений] [-n игр] [-m фигур]
+ * [-s зерно] [-b] [-j потоков] [-c контрольная точка]. Если контрольная
+ * точка существует, подбор продолжается с неё.
+ */
+int main(int argc, char **argv) {
+  static TuneState_t state;
+  TuneConfig_t config = {32,  50, 16, 500, 1, RANDOMIZER_UNIFORM,
+                         (int)sysconf(_SC_NPROCESSORS_ONLN), "tune.ckpt"};
+  int opt;
+  int ok = 1;
+  while (ok && (opt = getopt(argc, argv, "p:g:n:m:s:bj:c:")) != -1) {
+    if (opt == 'p') {
+      config.population = atoi(optarg);
+    } else if (opt == 'g') {
+      config.generations = atoi(optarg);
+    } else if (opt == 'n') {
+      config.games = atol(optarg);
+    } else if (opt == 'm') {
+      config.max_pieces = atol(optarg);
+    } else if (opt == 's') {
+      config.seed = strtoull(optarg, NULL, 10);
+    } else if (opt == 'b') {
+      config.randomizer = RANDOMIZER_BAG;
+    } else if (opt == 'j') {
+      config.threads = atoi(optarg);
+    } else if (opt == 'c') {
+      config.checkpoint = optarg;
+    } else {
+      ok = 0;
+    }
+  }
+  if (config.threads < 1) config.threads = 1;
+  if (!ok || config.population < 1 ||
+      config.population > TUNE_MAX_POPULATION || config.games < 1 ||
+      config.max_pieces < 1) {
+    fprintf(stderr,
+            "usage: %s [-p population] [-g generations] [-n games]"
+            " [-m max_pieces] [-s seed] [-b] [-j threads] [-c checkpoint]\n",
+            argv[0]);
+    return 1;
+  }
+  int loaded = loadCheckpoint(&config, &state);
+  if (loaded < 0) {
+    fprintf(stderr, "cannot resume from %s: unreadable or corrupt\n",
+            config.checkpoint);
+    return 1;
+  }
+  if (loaded) {
+    printf("resumed %s at generation %d (population %d, %ld games of %ld"
+           " pieces)\n",
+           config.checkpoint, state.generation, config.population,
+           config.games, config.max_pieces);
+  } else {
+    seedPopulation(&config, &state);
+  }
+  static double fitness[TUNE_MAX_POPULATION];
+  static int order[TUNE_MAX_POPULATION];
+  while (ok && state.generation < config.generations) {
+    double start = now();
+    if (!evaluate(&config, &state, fitness)) {
+      fprintf(stderr, "generation %d failed: out of memory or threads\n",
+              state.generation);
+      ok = 0;
+      break;
+    }
+    rank(config.population, fitness, order);
+    report(&config, &state, fitness, order, now() - start);
+    breed(&config, &state, fitness, order);
+    state.generation++;
+    ok = saveCheckpoint(&config, &state);
+    if (!ok) fprintf(stderr, "cannot write %s\n", config.checkpoint);
+  }
+  return !ok;
+}